@@ -3,15 +3,80 @@
 #include "../nodes/node_package.h"
 #include "../other/mm_stream.h"
 #include "data_structs/burda_hit.h"
+#include "data_structs/compact_hit.h"
 #include "data_structs/node_args.h"
+#include "data_structs/tick_hit.h"
 #include "nodes/raw_data_reader.h"
+#include <atomic>
 #include <cstdint>
 #include <fstream>
 #include <functional>
 #include <memory>
+#include <type_traits>
 #include <variant>
 
-template <template <typename> class reader_type, typename buffer_type>
+// buffer types which are opened by the name of the input file
+template <typename buffer_type>
+constexpr bool is_file_buffer_v =
+    std::is_same<buffer_type, std::ifstream>::value ||
+    std::is_same<buffer_type, mapped_char_buffer>::value ||
+    std::is_same<buffer_type, prefetching_file_buffer>::value;
+
+// readers which count the decoded frames
+template <typename reader_type, typename = void>
+struct has_frame_statistics : std::false_type
+{
+};
+
+template <typename reader_type>
+struct has_frame_statistics<
+    reader_type,
+    std::void_t<decltype(std::declval<const reader_type &>().statistics())>>
+  : std::true_type
+{
+};
+
+// sorters which count the hits arriving after the later hits were released
+template <typename sorter_type, typename = void>
+struct has_late_hit_count : std::false_type
+{
+};
+
+template <typename sorter_type>
+struct has_late_hit_count<
+    sorter_type,
+    std::void_t<decltype(std::declval<const sorter_type &>().late_hit_count())>>
+  : std::true_type
+{
+};
+
+// sorters which merge the remaining hits block by block at the end
+template <typename sorter_type, typename = void>
+struct has_gradual_merge : std::false_type
+{
+};
+
+template <typename sorter_type>
+struct has_gradual_merge<
+    sorter_type, std::void_t<decltype(std::declval<sorter_type &>().merge_next(
+                     std::declval<decltype(std::declval<sorter_type &>()
+                                               .result_hits()) &>()))>>
+  : std::true_type
+{
+};
+
+// the hits are carried as hit_type from the adapter to the output, tick_hit
+// keeps the times in integer ticks of the fast clock, compact_hit as well
+// in half of the memory of mm_hit, the hits are ordered by sorter_template
+// (hit_sorter, time_wheel_sorter, batch_sorter or external_sorter for the
+// datastreams without bounded unorderedness), either after the
+// calibration or already as burda hits if the sort_raw_hits arg is set
+// and the pixel list clustering is done by clusterer_template
+// (pixel_list_clusterer, pooled_pixel_list_clusterer or matrix_clusterer)
+template <template <typename> class reader_type, typename buffer_type,
+          typename hit_type = mm_hit,
+          template <typename> class sorter_template = hit_sorter,
+          template <typename> class clusterer_template = pixel_list_clusterer>
 class dataflow_controller
 {
 
@@ -24,109 +89,264 @@ class dataflow_controller
     NO_HDD_IO
   };
   using adapter_type = burda_to_mm_hit_adapter;
-  using sorter_type = hit_sorter<mm_hit>;
-  using clusterer_type = pixel_list_clusterer;
-  using mm_printer_type = data_printer<cluster<mm_hit>, mm_write_stream>;
+  using sorter_type = sorter_template<hit_type>;
+  using raw_sorter_type = sorter_template<burda_hit>;
+  using clusterer_type = clusterer_template<hit_type>;
+  using mm_printer_type = data_printer<cluster<hit_type>, mm_write_stream>;
   using burda_binary_printer_type = data_printer<burda_hit, std::ofstream>;
-  using cluster_splitter_type = cluster_splitter;
-  using temporal_clusterer_type = temporal_clusterer;
-  using result_callback_type =
-      std::function<void(std::vector<cluster<mm_hit>>::const_iterator,
-                         std::vector<cluster<mm_hit>>::const_iterator)>;
+  using cluster_splitter_type = cluster_splitter<hit_type>;
+  using temporal_clusterer_type = temporal_clusterer<hit_type>;
+  using result_callback_type = std::function<void(
+      typename std::vector<cluster<hit_type>>::const_iterator,
+      typename std::vector<cluster<hit_type>>::const_iterator)>;
+  // called with the late hit count and the max late delay (ns) so far
+  using late_hit_callback_type = std::function<void(uint64_t, double)>;
   std::unique_ptr<reader_type<buffer_type>> reader_;
   std::unique_ptr<adapter_type> adapter_;
   std::unique_ptr<sorter_type> sorter_;
+  // sorts the hits before the calibration, null if they are sorted after it
+  std::unique_ptr<raw_sorter_type> raw_sorter_;
   std::unique_ptr<clusterer_type> clusterer_;
   std::unique_ptr<mm_printer_type> printer_;
   std::unique_ptr<burda_binary_printer_type> raw_printer_;
   std::unique_ptr<cluster_splitter_type> cluster_splitter_;
   std::unique_ptr<temporal_clusterer_type> temp_clusterer_;
+  // block of hits decoded by the reader at once
+  std::vector<burda_hit> hit_batch_;
+  // the same block converted by the adapter
+  std::vector<hit_type> mm_hit_batch_;
+  // hits converted after the raw sorting, waiting for the clusterer
+  std::vector<hit_type> sorted_hit_batch_;
+  // copy of the counters of the reader, updated after each block so it can
+  // be read while the reader is replaced
+  frame_statistics statistics_;
+  // hits which arrived after the sorter released the hits following them,
+  // updated after each block as well
+  std::atomic<uint64_t> late_hit_count_{0};
+  std::atomic<double> max_late_delay_{0};
+  late_hit_callback_type late_hit_callback_;
 
   result_callback_type result_callback_;
   runtime_configuration runtime_config_;
+  node_args args_;
   const uint16_t MIN_BUFFER_SIZE = 128;
 
   bool done() { return reader_->done(); }
 
-  void finalize()
+  // decodes and converts the next block, its hits which are already in
+  // order are appended to sorted_hits()
+  void sort_next_block()
   {
-    auto last_hits = sorter_->process_remaining();
-    clusterer_->process_hits(last_hits.begin(), last_hits.end());
-    auto final_clusters = clusterer_->process_remaining();
-    if (runtime_config_ == runtime_configuration::USE_HDD_IO)
+    reader_->process_hits(hit_batch_);
+    if constexpr (has_frame_statistics<reader_type<buffer_type>>::value)
+      statistics_ = reader_->statistics();
+    if (raw_sorter_)
     {
-      printer_->process_data(final_clusters.begin(), final_clusters.end());
-      printer_->close();
+      raw_sorter_->process_hits(hit_batch_);
+      adapter_->process_hits(raw_sorter_->result_hits(), mm_hit_batch_);
+      raw_sorter_->result_hits().clear();
+      sorted_hit_batch_.insert(sorted_hit_batch_.end(),
+                               std::make_move_iterator(mm_hit_batch_.begin()),
+                               std::make_move_iterator(mm_hit_batch_.end()));
+    }
+    else
+    {
+      adapter_->process_hits(hit_batch_, mm_hit_batch_);
+      sorter_->process_hits(mm_hit_batch_);
+    }
+    if (raw_sorter_)
+      update_late_hits<burda_hit>(*raw_sorter_);
+    else
+      update_late_hits<hit_type>(*sorter_);
+  }
+
+  // reports the late hits of the block as soon as it was sorted
+  template <typename data_type, typename any_sorter_type>
+  void update_late_hits(const any_sorter_type &sorter)
+  {
+    if constexpr (has_late_hit_count<any_sorter_type>::value)
+    {
+      const uint64_t late_hit_count = sorter.late_hit_count();
+      if (late_hit_count == late_hit_count_.load(std::memory_order_relaxed))
+        return;
+      const double max_late_delay = data_type::to_ns(sorter.max_late_delay());
+      late_hit_count_.store(late_hit_count, std::memory_order_relaxed);
+      max_late_delay_.store(max_late_delay, std::memory_order_relaxed);
+      if (late_hit_callback_)
+        late_hit_callback_(late_hit_count, max_late_delay);
+    }
+  }
+
+  std::vector<hit_type> &sorted_hits()
+  {
+    return raw_sorter_ ? sorted_hit_batch_ : sorter_->result_hits();
+  }
+
+  // passes all hits left in the sorter at the end of the datastream to
+  // process_hits, in blocks if the sorter merges them gradually
+  template <typename any_sorter_type, typename process_type>
+  static void flush_sorter(any_sorter_type &sorter, process_type &&process_hits)
+  {
+    if constexpr (has_gradual_merge<any_sorter_type>::value)
+    {
+      std::vector<std::decay_t<decltype(sorter.result_hits().front())>> hits;
+      while (sorter.merge_next(hits))
+        process_hits(hits);
     }
     else
     {
-      result_callback_(final_clusters.cbegin(), final_clusters.cend());
+      auto hits = sorter.process_remaining();
+      process_hits(hits);
     }
   }
 
+  template <typename process_type>
+  void flush_sorted_hits(process_type &&process_hits)
+  {
+    if (!raw_sorter_)
+    {
+      flush_sorter(*sorter_, process_hits);
+      return;
+    }
+    // the hits released by the raw sorter precede the remaining ones
+    process_hits(sorted_hit_batch_);
+    sorted_hit_batch_.clear();
+    flush_sorter(*raw_sorter_,
+                 [this, &process_hits](std::vector<burda_hit> &hits)
+                 {
+                   adapter_->process_hits(hits, mm_hit_batch_);
+                   process_hits(mm_hit_batch_);
+                 });
+  }
+
+  // passes the clusters to the printer or to the callback
+  void emit_clusters(std::vector<cluster<hit_type>> &clusters)
+  {
+    if (runtime_config_ == runtime_configuration::USE_HDD_IO)
+      printer_->process_data(clusters.begin(), clusters.end());
+    else
+      result_callback_(clusters.cbegin(), clusters.cend());
+    clusters.clear();
+  }
+
+  void finalize()
+  {
+    // clusters buffered in the clusterer precede the remaining ones
+    flush_sorted_hits(
+        [this](std::vector<hit_type> &hits)
+        {
+          clusterer_->process_hits(hits.begin(), hits.end());
+          emit_clusters(clusterer_->result_clusters());
+        });
+    auto remaining_clusters = clusterer_->process_remaining();
+    emit_clusters(remaining_clusters);
+    if (runtime_config_ == runtime_configuration::USE_HDD_IO)
+      printer_->close();
+  }
+
   void two_step_finalize()
   {
-    auto last_hits = sorter_->process_remaining();
-    temp_clusterer_->process_hits(last_hits.begin(), last_hits.end());
+    flush_sorted_hits(
+        [this](std::vector<hit_type> &hits)
+        {
+          temp_clusterer_->process_hits(hits.begin(), hits.end());
+          // the last cluster may be extended by the following hits
+          auto &clusters = temp_clusterer_->result_clusters();
+          if (clusters.size() < 2)
+            return;
+          cluster_splitter_->process_data(clusters.begin(), clusters.end() - 1);
+          clusters.erase(clusters.begin(), clusters.end() - 1);
+          emit_clusters(cluster_splitter_->result_clusters());
+        });
     auto final_clusters = temp_clusterer_->process_remaining();
     cluster_splitter_->process_data(final_clusters.begin(),
                                     final_clusters.end());
     auto final_splitted_clusters = cluster_splitter_->process_remaining();
+    emit_clusters(final_splitted_clusters);
     if (runtime_config_ == runtime_configuration::USE_HDD_IO)
-    {
-      printer_->process_data(final_splitted_clusters.begin(),
-                             final_splitted_clusters.end());
       printer_->close();
-    }
-    else
-    {
-      result_callback_(final_splitted_clusters.cbegin(),
-                       final_splitted_clusters.cend());
-    }
   }
 
   std::string create_clustered_output_name(const std::string &input_name)
   {
     const char suffix_separator = '.';
     std::string output_name = input_name;
-    auto last_dot_index = input_name.rfind('.');
+    // the compression suffix is removed together with the file extension
+    if (prefetching_file_buffer::is_compressed(output_name))
+      output_name = output_name.substr(0, output_name.rfind('.'));
+    auto last_dot_index = output_name.rfind('.');
     if (last_dot_index != std::string::npos)
       output_name = output_name.substr(0, last_dot_index);
     return output_name + "_clustered";
   }
 
 public:
+  std::string name() { return "dataflow_controller"; }
+
+  // counters of the frames decoded by the reader so far, can be queried
+  // from another thread during the run as well, empty for the readers which
+  // do not decode frames
+  frame_statistics statistics() const { return statistics_; }
+
+  // the hits the sorter released out of order so far, can be queried from
+  // another thread during the run as well, zero for the sorters which do not
+  // count them
+  uint64_t late_hit_count() const
+  {
+    return late_hit_count_.load(std::memory_order_relaxed);
+  }
+
+  // the largest delay of a late hit so far in ns
+  double max_late_delay() const
+  {
+    return max_late_delay_.load(std::memory_order_relaxed);
+  }
+
+  // the callback is invoked after each block which brought late hits
+  void set_late_hit_callback(late_hit_callback_type &&callback)
+  {
+    late_hit_callback_ = std::move(callback);
+  }
+
   template <typename T = buffer_type,
             typename std::enable_if_t<std::is_same<T, raw_char_buffer>::value,
                                       int> = 0>
   dataflow_controller(const calibration &calib, result_callback_type &&callback,
                       const node_args &args = node_args())
-    : adapter_(std::make_unique<adapter_type>(calib)),
-      sorter_(std::make_unique<sorter_type>()),
+    : adapter_(std::make_unique<adapter_type>(calib, args)),
+      sorter_(std::make_unique<sorter_type>(args)),
       clusterer_(std::make_unique<clusterer_type>(args)),
       temp_clusterer_(std::make_unique<temporal_clusterer_type>()),
       cluster_splitter_(std::make_unique<cluster_splitter_type>()),
       result_callback_(callback),
-      runtime_config_(runtime_configuration::NO_HDD_IO)
+      runtime_config_(runtime_configuration::NO_HDD_IO), args_(args)
 
   {
+    create_raw_sorter(args);
   }
 
-  template <
-      typename T = buffer_type,
-      typename std::enable_if_t<std::is_same<T, std::ifstream>::value, int> = 0>
+  template <typename T = buffer_type,
+            typename std::enable_if_t<is_file_buffer_v<T>, int> = 0>
   dataflow_controller(const std::string &calib_folder,
                       const node_args &args = node_args())
 
     : adapter_(std::make_unique<adapter_type>(
-          calibration(calib_folder, current_chip::chip_type::size()))),
-      sorter_(std::make_unique<sorter_type>()),
+          calibration(calib_folder, current_chip::chip_type::size()), args)),
+      sorter_(std::make_unique<sorter_type>(args)),
       clusterer_(std::make_unique<clusterer_type>(args)),
       temp_clusterer_(std::make_unique<temporal_clusterer_type>()),
       cluster_splitter_(std::make_unique<cluster_splitter_type>()),
-      runtime_config_(runtime_configuration::USE_HDD_IO)
+      runtime_config_(runtime_configuration::USE_HDD_IO), args_(args)
 
   {
+    create_raw_sorter(args);
+  }
+
+  // the hits are sorted before the calibration if the arg is set
+  void create_raw_sorter(const node_args &args)
+  {
+    if (args.get_arg<bool>(name(), "sort_raw_hits"))
+      raw_sorter_ = std::make_unique<raw_sorter_type>(args);
   }
 
   template <typename T = buffer_type>
@@ -136,15 +356,13 @@ public:
     reader_ = std::move(
         std::make_unique<reader_type<buffer_type>>(data_pointer, size));
 
-    auto new_hit = reader_->process_hit();
     while (!done())
     {
-      sorter_->process_hit(adapter_->process_hit(new_hit));
-      if (sorter_->result_hits().size() > MIN_BUFFER_SIZE)
+      sort_next_block();
+      if (sorted_hits().size() > MIN_BUFFER_SIZE)
       {
-        clusterer_->process_hits(sorter_->result_hits().begin(),
-                                 sorter_->result_hits().end());
-        sorter_->result_hits().clear();
+        clusterer_->process_hits(sorted_hits().begin(), sorted_hits().end());
+        sorted_hits().clear();
       }
       if (clusterer_->result_clusters().size() > MIN_BUFFER_SIZE)
       {
@@ -152,28 +370,26 @@ public:
                          clusterer_->result_clusters().cend());
         clusterer_->result_clusters().clear();
       }
-      new_hit = reader_->process_hit();
     }
     finalize();
   }
 
   template <typename T = buffer_type>
-  typename std::enable_if_t<std::is_same<T, std::ifstream>::value>
+  typename std::enable_if_t<is_file_buffer_v<T>>
   run_pixel_list_clustering(const std::string &data_file)
   {
-    reader_ = std::move(std::make_unique<reader_type<buffer_type>>(data_file));
+    reader_ = std::move(
+        std::make_unique<reader_type<buffer_type>>(data_file, args_));
     printer_ = std::move(std::make_unique<mm_printer_type>(
         new mm_write_stream(create_clustered_output_name(data_file))));
 
-    auto new_hit = reader_->process_hit();
     while (!done())
     {
-      sorter_->process_hit(adapter_->process_hit(new_hit));
-      if (sorter_->result_hits().size() > MIN_BUFFER_SIZE)
+      sort_next_block();
+      if (sorted_hits().size() > MIN_BUFFER_SIZE)
       {
-        clusterer_->process_hits(sorter_->result_hits().begin(),
-                                 sorter_->result_hits().end());
-        sorter_->result_hits().clear();
+        clusterer_->process_hits(sorted_hits().begin(), sorted_hits().end());
+        sorted_hits().clear();
       }
       if (clusterer_->result_clusters().size() > MIN_BUFFER_SIZE)
       {
@@ -181,7 +397,6 @@ public:
                                clusterer_->result_clusters().end());
         clusterer_->result_clusters().clear();
       }
-      new_hit = reader_->process_hit();
     }
     finalize();
   }
@@ -193,15 +408,14 @@ public:
     reader_ = std::move(
         std::make_unique<reader_type<buffer_type>>(data_pointer, size));
 
-    auto new_hit = reader_->process_hit();
     while (!done())
     {
-      sorter_->process_hit(adapter_->process_hit(new_hit));
-      if (sorter_->result_hits().size() > MIN_BUFFER_SIZE)
+      sort_next_block();
+      if (sorted_hits().size() > MIN_BUFFER_SIZE)
       {
-        temp_clusterer_->process_hits(sorter_->result_hits().begin(),
-                                      sorter_->result_hits().end());
-        sorter_->result_hits().clear();
+        temp_clusterer_->process_hits(sorted_hits().begin(),
+                                      sorted_hits().end());
+        sorted_hits().clear();
       }
 
       if (temp_clusterer_->result_clusters().size() > MIN_BUFFER_SIZE)
@@ -218,29 +432,27 @@ public:
                          cluster_splitter_->result_clusters().cend());
         cluster_splitter_->result_clusters().clear();
       }
-      new_hit = reader_->process_hit();
     }
     two_step_finalize();
   }
 
   template <typename T = buffer_type>
-  typename std::enable_if_t<std::is_same<T, std::ifstream>::value>
+  typename std::enable_if_t<is_file_buffer_v<T>>
   run_temporal_split_clustering(const std::string &data_file)
   {
-    reader_ = std::move(std::make_unique<reader_type<buffer_type>>(data_file));
+    reader_ = std::move(
+        std::make_unique<reader_type<buffer_type>>(data_file, args_));
     printer_ = std::move(std::make_unique<mm_printer_type>(
         new mm_write_stream(create_clustered_output_name(data_file))));
 
-    auto new_hit = reader_->process_hit();
-
     while (!done())
     {
-      sorter_->process_hit(adapter_->process_hit(new_hit));
-      if (sorter_->result_hits().size() > MIN_BUFFER_SIZE)
+      sort_next_block();
+      if (sorted_hits().size() > MIN_BUFFER_SIZE)
       {
-        temp_clusterer_->process_hits(sorter_->result_hits().begin(),
-                                      sorter_->result_hits().end());
-        sorter_->result_hits().clear();
+        temp_clusterer_->process_hits(sorted_hits().begin(),
+                                      sorted_hits().end());
+        sorted_hits().clear();
       }
 
       if (temp_clusterer_->result_clusters().size() > MIN_BUFFER_SIZE)
@@ -257,7 +469,6 @@ public:
                                cluster_splitter_->result_clusters().end());
         cluster_splitter_->result_clusters().clear();
       }
-      new_hit = reader_->process_hit();
     }
     two_step_finalize();
   }
@@ -19,6 +19,9 @@ class burda_hit
   int16_t
       tot_; // can be zero because of chip error, so we set invalid value to -1
 public:
+  // the time used for sorting, in ticks of the fast clock
+  using time_type = int64_t;
+
   burda_hit(uint16_t linear_coord, int64_t toa, short fast_toa, int16_t tot);
   burda_hit(std::istream *in_stream);
   static constexpr uint64_t avg_size();
@@ -33,8 +36,14 @@ public:
   static constexpr uint64_t offset_tick_size = 16384;
   static constexpr uint64_t offset_modulus = 16384;
   uint64_t tick_toa() const;
+  // toa combined with the fast toa, in ticks of the fast clock
+  int64_t fast_tick_toa() const;
   double toa() const;
-  double time() const;
+  // the same as fast_tick_toa
+  time_type time() const;
+  // conversions between the time of the hit and nanoseconds
+  static time_type from_ns(double ns);
+  static double to_ns(time_type time);
 
   void update_time(uint64_t new_toa, short fast_toa);
   short fast_toa() const;
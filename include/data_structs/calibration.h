@@ -1,7 +1,9 @@
+#include "../other/mapped_file.h"
 #include "../other/utils.h"
 #include <cmath>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -17,20 +19,77 @@ class calibration
     C,
     T
   };
-  // the files with constants required for energy computation
-  std::vector<std::vector<double>> a_;
-  std::vector<std::vector<double>> b_;
-  std::vector<std::vector<double>> c_;
-  std::vector<std::vector<double>> t_;
+
+public:
+  // the constants required for energy computation of a single pixel,
+  // a single aligned load gives all of them
+  struct alignas(32) pixel_constants
+  {
+    double a;
+    double b;
+    double c;
+    double t;
+  };
+
+  // converts the ToTs of the pixels with the given linear indices
+  using batch_kernel_type = void (*)(const pixel_constants *constants,
+                                     const uint32_t *pixels,
+                                     const double *tots, double *energies,
+                                     uint64_t count);
+
+private:
+  // the text files the constants were parsed from, identified by their
+  // sizes and the checksum of their content
+  struct source_state
+  {
+    uint64_t sizes[4];
+    uint64_t checksum;
+  };
+
+  // header of the binary calibration cache, followed by the constants, it is
+  // padded so the mapped constants keep their alignment
+  struct alignas(pixel_constants) binary_header
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t row_count;
+    uint32_t row_length;
+    uint32_t reserved;
+    uint64_t checksum;
+    source_state source;
+  };
+  static_assert(sizeof(binary_header) % alignof(pixel_constants) == 0);
+
+  // constants of all pixels, row by row, unless they are mapped
+  std::vector<pixel_constants> constants_;
+  // binary cache mapped read-only, shared with the copies of the object
+  std::shared_ptr<mapped_file> mapping_;
+  uint32_t row_count_ = 0;
+  uint32_t row_length_ = 0;
+  batch_kernel_type batch_kernel_;
   static constexpr std::string_view a_suffix = "a.txt";
   static constexpr std::string_view b_suffix = "b.txt";
   static constexpr std::string_view c_suffix = "c.txt";
   static constexpr std::string_view t_suffix = "t.txt";
+  static constexpr std::string_view binary_suffix = "calibration.bin";
+  static constexpr uint32_t binary_version = 2;
 
   void load_calib_vector(std::string &&name, const coord &chip_size,
-                         std::vector<std::vector<double>> &vector);
+                         calib_type matrix_name);
   bool has_last_folder_separator(const std::string &path);
   std::string add_last_folder_separator(const std::string &path);
+  void resize(uint32_t row_count, uint32_t row_length);
+  double &constant(pixel_constants &pixel, calib_type matrix_name);
+  void select_batch_kernel();
+  const pixel_constants *constants() const;
+  static bool read_source_state(const std::string &calib_folder,
+                                source_state &source);
+  bool load_binary(const std::string &binary_name, const coord &chip_size,
+                   const source_state &source);
+  void save_binary(const std::string &binary_name,
+                   const source_state &source) const;
+  static uint64_t checksum(const char *bytes, uint64_t size,
+                           uint64_t hash = 0xcbf29ce484222325ULL);
 
 public:
   calibration(const std::string &calib_folder, const coord &chip_size);
@@ -40,6 +99,17 @@ public:
               const std::vector<std::vector<double>> &t);
   // does the conversion from ToT to E[keV]
   double compute_energy(short x, short y, double tot);
+  // converts a batch of hits, the pixels are given by their linear index
+  // y * row_length + x
+  void compute_energy(const uint32_t *pixels, const double *tots,
+                      double *energies, uint64_t count) const;
   void set_calib(const std::vector<std::vector<double>> &calib_matrix,
                  calib_type matrix_name);
-};
\ No newline at end of file
+
+  static void compute_energy_scalar(const pixel_constants *constants,
+                                    const uint32_t *pixels, const double *tots,
+                                    double *energies, uint64_t count);
+  static void compute_energy_avx(const pixel_constants *constants,
+                                 const uint32_t *pixels, const double *tots,
+                                 double *energies, uint64_t count);
+};
@@ -1,7 +1,9 @@
 #pragma once
+#include <climits>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <sstream>
 #include <utility>
 #include <vector>
@@ -9,10 +11,15 @@
 // cluster created during clustering, typically data_type = mm_hit
 template <typename data_type> class cluster
 {
+public:
+  using hit_type = data_type;
+  // ns for mm_hit, ticks of the fast clock for tick_hit
+  using time_type = typename data_type::time_type;
+
 protected:
   // store first and last toa for quick access
-  double first_toa_ = std::numeric_limits<double>::max();
-  double last_toa_ = -std::numeric_limits<double>::max();
+  time_type first_toa_ = std::numeric_limits<time_type>::max();
+  time_type last_toa_ = std::numeric_limits<time_type>::lowest();
   uint64_t hit_count_;
   std::vector<data_type> hits_;
 
@@ -52,9 +59,9 @@ public:
 
   virtual ~cluster() = default;
 
-  double first_toa() const { return first_toa_; }
+  time_type first_toa() const { return first_toa_; }
 
-  double last_toa() const { return last_toa_; }
+  time_type last_toa() const { return last_toa_; }
 
   /*uint64_t line_start() const
   {
@@ -90,9 +97,9 @@ public:
     return tot_energy;
   }
 
-  void set_first_toa(double toa) { first_toa_ = toa; }
+  void set_first_toa(time_type toa) { first_toa_ = toa; }
 
-  void set_last_toa(double toa) { last_toa_ = toa; }
+  void set_last_toa(time_type toa) { last_toa_ = toa; }
 
   uint64_t size()
   {
@@ -112,7 +119,7 @@ public:
       *px_stream << "#" << std::endl;
       //return result.str();
   }*/
-  double time() const { return first_toa(); }
+  time_type time() const { return first_toa(); }
 
   void temporal_sort()
   {
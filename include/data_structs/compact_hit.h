@@ -0,0 +1,62 @@
+#pragma once
+#include "../other/utils.h"
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// a 16 byte variant of tick_hit for the memory bound runs, the coordinates
+// are stored in 8 bits (the chip has 256x256 pixels) and the energy
+// in single precision
+class compact_hit
+{
+  // time of arrival in ticks of the fast clock
+  int64_t toa_;
+  // deposited energy in keV
+  float e_;
+  // spatial pixel coordinates (x,y)
+  uint8_t x_;
+  uint8_t y_;
+
+public:
+  using time_type = int64_t;
+
+  compact_hit(short x, short y, int64_t toa, double e);
+  compact_hit();
+
+  // conversions between the time of the hit and nanoseconds
+  static time_type from_ns(double ns);
+  static double to_ns(time_type time);
+
+  coord coordinates() const;
+  short x() const;
+  short y() const;
+  int64_t time() const;
+  int64_t toa() const;
+  double toa_ns() const;
+  double e() const;
+  bool approx_equals(const compact_hit &other);
+};
+
+static_assert(sizeof(compact_hit) == 16, "compact_hit is expected to be 16B");
+
+// hit serialization, the time is written in ns
+template <typename stream_type>
+stream_type &operator<<(stream_type &os, const compact_hit &hit)
+{
+  os << hit.x() << " " << hit.y() << " " << double_to_str(hit.toa_ns()) << " ";
+  os << double_to_str(hit.e(), 2) << "\n";
+
+  return os;
+}
+
+// hit deserialization, the time is read in ns
+template <typename stream_type>
+stream_type &operator>>(stream_type &istream, compact_hit &hit)
+{
+  short x, y;
+  double toa, e;
+  istream >> x >> y >> toa >> e;
+  hit = compact_hit(x, y, compact_hit::from_ns(toa), e);
+
+  return istream;
+}
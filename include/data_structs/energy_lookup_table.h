@@ -0,0 +1,80 @@
+#pragma once
+#include "../other/utils.h"
+#include "calibration.h"
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+// energies precomputed for each (pixel, ToT) pair, so the conversion of most
+// hits is a single load from the table, the rows of the pixels are populated
+// lazily and only as many pixels as the memory budget allows are tabulated
+class energy_lookup_table
+{
+public:
+  enum class precision
+  {
+    FLOAT,
+    HALF
+  };
+  // the ToT of the pixel frames has 10 bits
+  static constexpr uint32_t TOT_VALUE_COUNT = 1 << 10;
+
+private:
+  static constexpr uint32_t NO_SLOT = std::numeric_limits<uint32_t>::max();
+
+  calibration &calib_;
+  precision precision_;
+  uint16_t row_length_;
+  // slot of the table row of each pixel, NO_SLOT if not tabulated yet
+  std::vector<uint32_t> pixel_slots_;
+  uint32_t used_slot_count_ = 0;
+  uint32_t max_slot_count_;
+  // zero marks the entries not computed yet, valid energies are positive
+  std::vector<float> float_energies_;
+  std::vector<uint16_t> half_energies_;
+
+  uint32_t assign_slot(uint32_t pixel);
+  static uint16_t float_to_half(float value);
+
+  static float half_to_float(uint16_t value)
+  {
+    // only positive normal numbers are stored in the table
+    uint32_t bits = ((value & 0x8000U) << 16) |
+                    ((((value >> 10) & 0x1fU) + 112) << 23) |
+                    ((value & 0x3ffU) << 13);
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+  }
+
+public:
+  energy_lookup_table(calibration &calib, const coord &chip_size,
+                      precision table_precision, uint64_t memory_budget);
+
+  static precision parse_precision(const std::string &name);
+
+  // does the conversion from ToT to E[keV]
+  double compute_energy(short x, short y, int16_t tot)
+  {
+    const uint32_t pixel = uint32_t(y) * row_length_ + x;
+    uint32_t slot = pixel_slots_[pixel];
+    if (slot == NO_SLOT)
+      slot = assign_slot(pixel);
+    if (slot == NO_SLOT || uint16_t(tot) >= TOT_VALUE_COUNT)
+      return calib_.compute_energy(x, y, tot);
+    const uint64_t index = uint64_t(slot) * TOT_VALUE_COUNT + tot;
+    if (precision_ == precision::FLOAT)
+    {
+      if (float_energies_[index] == 0)
+        float_energies_[index] = calib_.compute_energy(x, y, tot);
+      return float_energies_[index];
+    }
+    if (half_energies_[index] == 0)
+      half_energies_[index] = float_to_half(calib_.compute_energy(x, y, tot));
+    return half_to_float(half_energies_[index]);
+  }
+
+  uint32_t tabulated_pixel_count() const;
+};
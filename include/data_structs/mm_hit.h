@@ -18,9 +18,15 @@ class mm_hit
   double e_;
 
 public:
+  using time_type = double;
+
   mm_hit(short x, short y, double toa, double e);
   mm_hit();
 
+  // conversions between the time of the hit and nanoseconds
+  static time_type from_ns(double ns);
+  static double to_ns(time_type time);
+
   const coord &coordinates() const;
   short x() const;
   short y() const;
@@ -0,0 +1,61 @@
+#pragma once
+#include "../other/utils.h"
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// the same hit as mm_hit, but its time is an integer number of ticks
+// of the fast clock, so the time comparisons in the pipeline are exact
+// and the time is converted to nanoseconds only at the output
+class tick_hit
+{
+  // spatial pixel coordinates (x,y)
+  coord coord_;
+  // time of arrival in ticks of the fast clock
+  int64_t toa_;
+  // deposited energy in keV
+  double e_;
+
+public:
+  using time_type = int64_t;
+  // length of a tick in ns
+  static constexpr double tick_ns = 1.5625;
+
+  tick_hit(short x, short y, int64_t toa, double e);
+  tick_hit();
+
+  // conversions between the time of the hit and nanoseconds
+  static time_type from_ns(double ns);
+  static double to_ns(time_type time);
+
+  const coord &coordinates() const;
+  short x() const;
+  short y() const;
+  int64_t time() const;
+  int64_t toa() const;
+  double toa_ns() const;
+  double e() const;
+  bool approx_equals(const tick_hit &other);
+};
+
+// hit serialization, the time is written in ns
+template <typename stream_type>
+stream_type &operator<<(stream_type &os, const tick_hit &hit)
+{
+  os << hit.x() << " " << hit.y() << " " << double_to_str(hit.toa_ns()) << " ";
+  os << double_to_str(hit.e(), 2) << "\n";
+
+  return os;
+}
+
+// hit deserialization, the time is read in ns
+template <typename stream_type>
+stream_type &operator>>(stream_type &istream, tick_hit &hit)
+{
+  short x, y;
+  double toa, e;
+  istream >> x >> y >> toa >> e;
+  hit = tick_hit(x, y, tick_hit::from_ns(toa), e);
+
+  return istream;
+}
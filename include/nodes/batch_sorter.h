@@ -0,0 +1,116 @@
+#pragma once
+#include "../data_structs/node_args.h"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// sorts the hits temporally block by block, the decoded blocks are nearly
+// sorted runs so each of them is sorted by insertion and merged with the
+// hits of the previous blocks which are still within the dequeue time
+template <typename data_type> class batch_sorter
+{
+  using time_type = typename data_type::time_type;
+  // maximal unorderedness of the datastream
+  const time_type dequeue_time_;
+  // the insertion sort gives up after this many moves per hit on average
+  static constexpr uint32_t MAX_INSERTION_MOVES = 8;
+  // sorted hits which may still be preceded by the hits of the next blocks
+  std::vector<data_type> pending_hits_;
+  std::vector<data_type> result_hits_;
+
+  static bool toa_less(const data_type &left, const data_type &right)
+  {
+    return left.time() < right.time();
+  }
+
+  // returns false if the block is too far from being sorted
+  static bool insertion_sort(std::vector<data_type> &hits)
+  {
+    uint64_t move_budget = uint64_t(MAX_INSERTION_MOVES) * hits.size();
+    for (uint64_t i = 1; i < hits.size(); ++i)
+    {
+      if (!toa_less(hits[i], hits[i - 1]))
+        continue;
+      data_type hit = std::move(hits[i]);
+      uint64_t j = i;
+      for (; j > 0 && toa_less(hit, hits[j - 1]); --j)
+        hits[j] = std::move(hits[j - 1]);
+      hits[j] = std::move(hit);
+      if (i - j > move_budget)
+        return false;
+      move_budget -= i - j;
+    }
+    return true;
+  }
+
+  static void sort_block(std::vector<data_type> &hits)
+  {
+    if (!insertion_sort(hits))
+      std::sort(hits.begin(), hits.end(), toa_less);
+  }
+
+  // moves the pending hits older than toa to the result
+  void release_before(time_type toa)
+  {
+    auto release_end =
+        std::lower_bound(pending_hits_.begin(), pending_hits_.end(), toa,
+                         [](const data_type &hit, time_type time)
+                         { return hit.time() < time; });
+    result_hits_.insert(result_hits_.end(),
+                        std::make_move_iterator(pending_hits_.begin()),
+                        std::make_move_iterator(release_end));
+    pending_hits_.erase(pending_hits_.begin(), release_end);
+  }
+
+public:
+  std::vector<data_type> &result_hits() { return result_hits_; }
+
+  batch_sorter(const node_args &args = node_args())
+    : dequeue_time_(
+          data_type::from_ns(args.get_arg<double>(name(), "dequeue_time"))),
+      pending_hits_(), result_hits_()
+  {
+    if (dequeue_time_ < 0)
+      throw std::invalid_argument("The dequeue_time of '" + name() +
+                                  "' must not be negative");
+  }
+
+  std::string name() { return "batch_sorter"; }
+
+  // sorts the block and merges it to the pending hits, the content of the
+  // block is moved
+  void process_hits(std::vector<data_type> &hits)
+  {
+    if (hits.empty())
+      return;
+    sort_block(hits);
+    const uint64_t old_size = pending_hits_.size();
+    pending_hits_.insert(pending_hits_.end(),
+                         std::make_move_iterator(hits.begin()),
+                         std::make_move_iterator(hits.end()));
+    hits.clear();
+    // only the pending hits after the first hit of the block are merged
+    auto block_begin = pending_hits_.begin() + old_size;
+    auto merge_begin = std::upper_bound(pending_hits_.begin(), block_begin,
+                                        *block_begin, toa_less);
+    if (merge_begin != block_begin)
+      std::inplace_merge(merge_begin, block_begin, pending_hits_.end(),
+                         toa_less);
+    release_before(pending_hits_.back().time() - dequeue_time_);
+  }
+
+  std::vector<data_type> process_remaining()
+  {
+    // remove the remaining hits at the end of datastream
+    result_hits_.insert(result_hits_.end(),
+                        std::make_move_iterator(pending_hits_.begin()),
+                        std::make_move_iterator(pending_hits_.end()));
+    pending_hits_.clear();
+    return result_hits_;
+  }
+
+  virtual ~batch_sorter() = default;
+};
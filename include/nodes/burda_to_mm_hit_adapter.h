@@ -1,7 +1,9 @@
 #pragma once
 #include "../data_structs/burda_hit.h"
 #include "../data_structs/calibration.h"
+#include "../data_structs/energy_lookup_table.h"
 #include "../data_structs/mm_hit.h"
+#include "../data_structs/node_args.h"
 #include "../devices/current_device.h"
 #include "../other/utils.h"
 #include <algorithm>
@@ -19,11 +21,26 @@ class burda_to_mm_hit_adapter
   uint16_t last_x;
   uint16_t last_y;
   std::unique_ptr<calibration> calibrator_;
+  // optional precomputed energies, null if the energy is always computed
+  std::unique_ptr<energy_lookup_table> energy_table_;
   uint64_t repetition_counter = 0;
+  // intermediate storage for the batch conversion
+  std::vector<uint32_t> batch_pixels_;
+  std::vector<double> batch_tots_;
+  std::vector<double> batch_energies_;
   // an option to ignore repetetive hits (indication of chip failure)
   bool ignore_repeating_pixel = false;
   uint16_t max_faulty_repetition_count = 10;
 
+  // the integer times are kept in ticks of the fast clock, the others in ns
+  template <typename hit_type> static auto hit_time(const burda_hit &in_hit)
+  {
+    if constexpr (std::is_integral<typename hit_type::time_type>::value)
+      return in_hit.fast_tick_toa();
+    else
+      return in_hit.toa();
+  }
+
 public:
   const double fast_clock_dt = 1.5625; // nanoseconds
   const double slow_clock_dt = 25.;
@@ -34,21 +51,76 @@ public:
     double toa = in_hit.toa();
     short y = in_hit.linear_coord() / chip_width_;
     short x = in_hit.linear_coord() % chip_width_;
+    if (energy_table_)
+      return mm_hit(x, y, toa,
+                    energy_table_->compute_energy(x, y, in_hit.tot()));
     return mm_hit(x, y, toa, calibrator_->compute_energy(x, y, (in_hit.tot())));
   }
 
-  burda_to_mm_hit_adapter(calibration &&calib)
+  // converts a whole block of hits, the energies are computed at once
+  template <typename hit_type>
+  void process_hits(const std::vector<burda_hit> &in_hits,
+                    std::vector<hit_type> &out_hits)
+  {
+    out_hits.clear();
+    out_hits.reserve(in_hits.size());
+    batch_energies_.resize(in_hits.size());
+    if (energy_table_)
+    {
+      for (uint64_t i = 0; i < in_hits.size(); ++i)
+        batch_energies_[i] = energy_table_->compute_energy(
+            in_hits[i].linear_coord() % chip_width_,
+            in_hits[i].linear_coord() / chip_width_, in_hits[i].tot());
+    }
+    else
+    {
+      batch_pixels_.resize(in_hits.size());
+      batch_tots_.resize(in_hits.size());
+      for (uint64_t i = 0; i < in_hits.size(); ++i)
+      {
+        batch_pixels_[i] = in_hits[i].linear_coord();
+        batch_tots_[i] = in_hits[i].tot();
+      }
+      calibrator_->compute_energy(batch_pixels_.data(), batch_tots_.data(),
+                                  batch_energies_.data(), in_hits.size());
+    }
+    for (uint64_t i = 0; i < in_hits.size(); ++i)
+      out_hits.emplace_back(in_hits[i].linear_coord() % chip_width_,
+                            in_hits[i].linear_coord() / chip_width_,
+                            hit_time<hit_type>(in_hits[i]),
+                            batch_energies_[i]);
+  }
+
+  burda_to_mm_hit_adapter(calibration &&calib,
+                          const node_args &args = node_args())
     : chip_height_(current_chip::chip_type::size_x()),
       chip_width_(current_chip::chip_type::size_y()), calibrate_(true),
       calibrator_(std::make_unique<calibration>(std::move(calib)))
   {
+    create_energy_table(args);
   }
 
-  burda_to_mm_hit_adapter(const calibration &calib)
+  burda_to_mm_hit_adapter(const calibration &calib,
+                          const node_args &args = node_args())
     : chip_height_(current_chip::chip_type::size_x()),
       chip_width_(current_chip::chip_type::size_y()), calibrate_(true),
       calibrator_(std::make_unique<calibration>(calib))
   {
+    create_energy_table(args);
+  }
+
+  // the lookup table is used if its precision is selected
+  void create_energy_table(const node_args &args)
+  {
+    const std::string table_precision =
+        args.get_arg<std::string>(name(), "energy_lut");
+    if (table_precision == "none")
+      return;
+    energy_table_ = std::make_unique<energy_lookup_table>(
+        *calibrator_, current_chip::chip_type::size(),
+        energy_lookup_table::parse_precision(table_precision),
+        std::stoull(
+            args.get_arg<std::string>(name(), "energy_lut_memory_budget")));
   }
 
   std::string name() { return "burda_to_mm_adapter"; }
@@ -9,13 +9,14 @@
 #include <stack>
 #include <sys/types.h>
 
-class cluster_splitter
+template <typename hit_type = mm_hit> class cluster_splitter
 {
-  using cluster_it = std::vector<cluster<mm_hit>>::iterator;
+  using time_type = typename hit_type::time_type;
+  using cluster_it = typename std::vector<cluster<hit_type>>::iterator;
 
   struct partitioned_hit
   {
-    double toa;
+    time_type toa;
     coord coordinates;
     uint32_t partition_index;
 
@@ -23,7 +24,7 @@ class cluster_splitter
 
     ushort y() { return coordinates.y(); }
 
-    partitioned_hit(double toa, const coord &coordinates)
+    partitioned_hit(time_type toa, const coord &coordinates)
       : toa(toa), partition_index(0), coordinates(coordinates)
     {
     }
@@ -32,9 +33,9 @@ class cluster_splitter
   struct partition_time_pair
   {
     uint32_t partition_index;
-    double toa;
+    time_type toa;
 
-    partition_time_pair(double toa, uint32_t partition_index)
+    partition_time_pair(time_type toa, uint32_t partition_index)
       : toa(toa), partition_index(partition_index)
     {
     }
@@ -55,21 +56,21 @@ class cluster_splitter
     }
   };
 
-  using timestamp_it = std::vector<partitioned_hit>::iterator;
+  using timestamp_it = typename std::vector<partitioned_hit>::iterator;
 
   const std::vector<coord> EIGHT_NEIGHBORS = {{-1, -1}, {-1, 0}, {-1, 1},
                                               {0, -1},  {0, 0},  {0, 1},
                                               {1, -1},  {1, 0},  {1, 1}};
-  const double MAX_JOIN_TIME = 200.;
+  const time_type MAX_JOIN_TIME = hit_type::from_ns(200.);
   pixel_matrix pixel_matrix_;
   std::vector<timestamp_it> timestamp_references_;
-  std::vector<cluster<mm_hit>> result_clusters_;
+  std::vector<cluster<hit_type>> result_clusters_;
   u_int64_t clusters_procesed_ = 0;
 
   // std::vector<partition_time_pair> partition_time_pairs_;
-  std::vector<cluster<mm_hit>> temp_clusters_;
+  std::vector<cluster<hit_type>> temp_clusters_;
 
-  void store_to_matrix(const cluster<mm_hit> &cluster)
+  void store_to_matrix(const cluster<hit_type> &cluster)
   {
     const size_t MAX_SAME_HIT_COUNT = 10;
     for (const auto &hit : cluster.hits())
@@ -129,7 +130,7 @@ class cluster_splitter
     }
   }
 
-  void label_components(const cluster<mm_hit> &cluster)
+  void label_components(const cluster<hit_type> &cluster)
   {
     uint32_t current_partition_index = 1;
     for (uint32_t i = 0; i < timestamp_references_.size(); ++i)
@@ -142,7 +143,7 @@ class cluster_splitter
     }
   }
 
-  void split_cluster(cluster<mm_hit> &&cluster)
+  void split_cluster(cluster<hit_type> &&cluster)
   {
     auto buffered_cluster_count = result_clusters_.size();
     /*for (uint32_t i = 0; i < timestamp_references_.size(); ++i)
@@ -173,7 +174,7 @@ class cluster_splitter
   }
 
 public:
-  void process_cluster(cluster<mm_hit> &&cluster)
+  void process_cluster(cluster<hit_type> &&cluster)
   {
     if (cluster.hits().size() == 1)
     {
@@ -199,7 +200,13 @@ public:
 
   cluster_splitter() : result_clusters_(){};
 
-  std::vector<cluster<mm_hit>> process_remaining() { return result_clusters_; }
+  std::vector<cluster<hit_type>> process_remaining()
+  {
+    return result_clusters_;
+  }
 
-  std::vector<cluster<mm_hit>> &result_clusters() { return result_clusters_; }
+  std::vector<cluster<hit_type>> &result_clusters()
+  {
+    return result_clusters_;
+  }
 };
\ No newline at end of file
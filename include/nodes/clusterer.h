@@ -19,22 +19,36 @@
 #include <vector>
 
 template <typename mm_hit> struct unfinished_cluster;
-using cluster_list = std::list<unfinished_cluster<mm_hit>>;
-using cluster_it = typename cluster_list::iterator;
-using cluster_it_list = typename std::list<cluster_it>;
+template <typename hit_type = mm_hit>
+using cluster_list = std::list<unfinished_cluster<hit_type>>;
+template <typename hit_type = mm_hit>
+using cluster_it = typename cluster_list<hit_type>::iterator;
+template <typename hit_type = mm_hit>
+using cluster_it_list = typename std::list<cluster_it<hit_type>>;
+
+// a chunk of the hits of an unfinished cluster
+template <typename mm_hit> struct hit_chunk
+{
+  std::vector<mm_hit> hits;
+  // iterators pointing to pixels matrix entries (which are iterators of the
+  // hits)
+  std::vector<typename cluster_it_list<mm_hit>::iterator> pixel_iterators;
+};
 
 // an auxiliary structure for cluster that is open at a time
 template <typename mm_hit> struct unfinished_cluster
 {
+  // holds the first and last toa, the hits are moved to it once the cluster
+  // is finished
   cluster<mm_hit> cl;
-  // iterators pointing to pixels matrix entries (which are iterators of the
-  // hits)
-  std::vector<typename cluster_it_list::iterator> pixel_iterators;
+  // the chunks of the merged clusters are spliced in O(1)
+  std::list<hit_chunk<mm_hit>> chunks;
+  uint64_t hit_count = 0;
   // self reference
-  cluster_it self;
+  cluster_it<mm_hit> self;
   bool selected = false;
 
-  unfinished_cluster() {}
+  unfinished_cluster() : chunks(1) {}
 
   void select() { selected = true; }
 
@@ -42,67 +56,113 @@ template <typename mm_hit> struct unfinished_cluster
 };
 
 // a node which implements the pixels list clustering as proposed by P.Manek
-class pixel_list_clusterer
+template <typename hit_type = mm_hit> class pixel_list_clusterer
 {
 private:
-  std::vector<cluster_it_list> pixel_lists_;
-  cluster_list unfinished_clusters_;
+  using time_type = typename hit_type::time_type;
+  std::vector<cluster_it_list<hit_type>> pixel_lists_;
+  cluster_list<hit_type> unfinished_clusters_;
   uint32_t unfinished_clusters_count_;
   bool finished_ = false;
   uint64_t processed_hit_count_;
-  double current_toa_;
+  time_type current_toa_;
   uint32_t tile_size_;
+  // the pixel lists are stored in the Z-order instead of the row-major order
+  bool morton_layout_;
   const std::vector<coord> EIGHT_NEIGHBORS = {{-1, -1}, {-1, 0}, {-1, 1},
                                               {0, -1},  {0, 0},  {0, 1},
                                               {1, -1},  {1, 0},  {1, 1}};
   const uint32_t WRITE_INTERVAL = 2 << 2;
-  using hit_vect_iterator = std::vector<mm_hit>::iterator;
+  using hit_vect_iterator = typename std::vector<hit_type>::iterator;
   using optional_clusters =
-      std::optional<std::vector<mm_hit, std::allocator<mm_hit>>>;
+      std::optional<std::vector<hit_type, std::allocator<hit_type>>>;
   uint64_t merge_count_ = 0;
-  std::vector<cluster<mm_hit>> result_clusters_;
+  std::vector<cluster<hit_type>> result_clusters_;
   uint64_t processed_clusters_ = 0;
+  // one bit per pixel list which is set while the list is not empty, each
+  // row is padded by a bit on both sides
+  std::vector<uint64_t> occupancy_;
+  uint32_t occupancy_row_words_;
 
 protected:
-  double cluster_diff_dt =
-      200.; // time that marks the max difference of cluster last_toa()
+  time_type cluster_diff_dt = hit_type::from_ns(
+      200.); // time that marks the max difference of cluster last_toa()
 
-  bool is_old(double last_toa, const cluster<mm_hit> &cl)
+  bool is_old(time_type last_toa, const cluster<hit_type> &cl)
   {
     return cl.last_toa() < last_toa - cluster_diff_dt;
   }
 
-  void merge_clusters(unfinished_cluster<mm_hit> &base_cluster,
-                      unfinished_cluster<mm_hit> &new_cluster)
+  uint32_t pixel_index(const coord &pixel) const
+  {
+    return morton_layout_ ? pixel.linearize_morton(tile_size_)
+                          : pixel.linearize(tile_size_);
+  }
+
+  uint32_t pixel_list_count() const
+  {
+    return morton_layout_ ? coord::morton_size(tile_size_)
+                          : current_chip::chip_type::size_x() *
+                                current_chip::chip_type::size_y() /
+                                (tile_size_ * tile_size_);
+  }
+
+  void reset_occupancy()
+  {
+    const uint32_t row_size = coord::MAX_VALUE / tile_size_;
+    occupancy_row_words_ = (row_size + 2 + 63) / 64;
+    occupancy_.assign(row_size * occupancy_row_words_, 0);
+  }
+
+  void set_occupied(const coord &pixel, bool occupied)
+  {
+    const uint32_t column = pixel.y() / tile_size_ + 1;
+    const uint32_t row = pixel.x() / tile_size_;
+    uint64_t &word = occupancy_[row * occupancy_row_words_ + column / 64];
+    const uint64_t bit = uint64_t(1) << (column % 64);
+    word = occupied ? word | bit : word & ~bit;
+  }
+
+  // checks the bits of the 3x3 neighborhood, so the isolated hits do not need
+  // to search the pixel lists
+  bool has_occupied_neighbor(const coord &pixel) const
+  {
+    const int32_t row = pixel.x() / tile_size_;
+    const int32_t last_row = coord::MAX_VALUE / tile_size_ - 1;
+    // the left neighbor is at the unshifted column thanks to the padding
+    const uint32_t column = pixel.y() / tile_size_;
+    const uint32_t shift = column % 64;
+    for (int32_t i = std::max(row - 1, 0); i <= std::min(row + 1, last_row);
+         ++i)
+    {
+      const uint64_t *words =
+          &occupancy_[i * occupancy_row_words_ + column / 64];
+      uint64_t bits = words[0] >> shift;
+      if (shift > 61)
+        bits |= words[1] << (64 - shift);
+      if (bits & 7)
+        return true;
+    }
+    return false;
+  }
+
+  void merge_clusters(unfinished_cluster<hit_type> &base_cluster,
+                      unfinished_cluster<hit_type> &new_cluster)
   // merging clusters to biggest cluster will however disrupt time orderedness -
   // after merging bigger cluster can lower its first toa which causes time
   // unorderedness, can hovewer improve performance try always merging to left
   // (smaller toa)
   {
 
-    for (auto &pix_it : new_cluster.pixel_iterators) // update iterator
-    {
-      *pix_it = base_cluster.self;
-    }
+    for (auto &chunk : new_cluster.chunks)
+      for (auto &pix_it : chunk.pixel_iterators) // update iterator
+      {
+        *pix_it = base_cluster.self;
+      }
 
-    base_cluster.cl.hits().reserve(base_cluster.cl.hits().size() +
-                                   new_cluster.cl.hits().size());
-    base_cluster.cl.hits().insert(
-        base_cluster.cl.hits().end(),
-        std::make_move_iterator(new_cluster.cl.hits().begin()),
-        std::make_move_iterator(
-            new_cluster.cl.hits()
-                .end())); // TODO try hits in std list and then concat in O(1)
-
-    // merge clusters
-    base_cluster.pixel_iterators.reserve(base_cluster.pixel_iterators.size() +
-                                         new_cluster.pixel_iterators.size());
-    base_cluster.pixel_iterators.insert(
-        base_cluster.pixel_iterators.end(),
-        std::make_move_iterator(new_cluster.pixel_iterators.begin()),
-        std::make_move_iterator(
-            new_cluster.pixel_iterators
-                .end())); // TODO try hits in std list and then concat in O(1)
+    // merge clusters, the hits are not moved
+    base_cluster.chunks.splice(base_cluster.chunks.end(), new_cluster.chunks);
+    base_cluster.hit_count += new_cluster.hit_count;
 
     // update first and last toa
     base_cluster.cl.set_first_toa(
@@ -114,20 +174,24 @@ protected:
     --unfinished_clusters_count_;
   }
 
-  std::vector<cluster_it> find_neighboring_clusters(const coord &base_coord,
-                                                    double toa,
-                                                    cluster_it &oldest_cluster)
+  std::vector<cluster_it<hit_type>>
+  find_neighboring_clusters(const coord &base_coord, time_type toa,
+                            cluster_it<hit_type> &oldest_cluster)
   {
-    std::vector<cluster_it> uniq_neighbor_cluster_its;
-    double min_toa = std::numeric_limits<double>::max();
+    std::vector<cluster_it<hit_type>> uniq_neighbor_cluster_its;
+    time_type min_toa = std::numeric_limits<time_type>::max();
+    const uint32_t base_index = base_coord.linearize(tile_size_);
     for (auto neighbor_offset : EIGHT_NEIGHBORS) // check all neighbor indexes
     {
       if (!base_coord.is_valid_neighbor(neighbor_offset, tile_size_))
         continue;
-      // error in computing neighbor offset linearize() - does not account for
-      // tile size
-      uint32_t neighbor_index = neighbor_offset.linearize_tiled(tile_size_) +
-                                base_coord.linearize(tile_size_);
+      // the row-major neighbors are at constant offsets
+      uint32_t neighbor_index =
+          morton_layout_
+              ? coord(base_coord.x() + neighbor_offset.x() * tile_size_,
+                      base_coord.y() + neighbor_offset.y() * tile_size_)
+                    .linearize_morton(tile_size_)
+              : neighbor_offset.linearize_tiled(tile_size_) + base_index;
 
       for (auto &neighbor_cl_it :
            pixel_lists_[neighbor_index]) // iterate over each cluster neighbor
@@ -162,9 +226,9 @@ protected:
 public:
   std::string name() { return "clusterer"; }
 
-  std::vector<cluster_it> get_all_unfinished_clusters()
+  std::vector<cluster_it<hit_type>> get_all_unfinished_clusters()
   {
-    std::vector<cluster_it> unfinished_its;
+    std::vector<cluster_it<hit_type>> unfinished_its;
     for (auto it = unfinished_clusters_.begin();
          it != unfinished_clusters_.end(); ++it)
     {
@@ -173,36 +237,48 @@ public:
     return unfinished_its;
   }
 
-  void add_new_hit(mm_hit &&hit, cluster_it &cluster_iterator)
+  void add_new_hit(hit_type &&hit, cluster_it<hit_type> &cluster_iterator)
   {
     // update cluster itself, assumes the cluster exists
     auto &target_pixel_list =
-        pixel_lists_[hit.coordinates().linearize(tile_size_)];
+        pixel_lists_[pixel_index(hit.coordinates())];
     target_pixel_list.push_front(cluster_iterator);
-    cluster_iterator->pixel_iterators.push_back(
-        target_pixel_list
-            .begin()); // beware, we need to push in the same order,
-                       // as we push hits in addhit and in merging
-    cluster_iterator->cl.add_hit(std::move(hit));
+    set_occupied(hit.coordinates(), true);
+    auto &chunk = cluster_iterator->chunks.back();
+    chunk.pixel_iterators.push_back(
+        target_pixel_list.begin()); // beware, we need to push in the same
+                                    // order, as we push hits
+    auto &target_cl = cluster_iterator->cl;
+    target_cl.set_first_toa(std::min(target_cl.first_toa(), hit.toa()));
+    target_cl.set_last_toa(std::max(target_cl.last_toa(), hit.toa()));
+    ++cluster_iterator->hit_count;
+    chunk.hits.emplace_back(std::move(hit));
     // update the pixel list
   }
 
-  std::vector<cluster<mm_hit>>
-  get_old_clusters(std::vector<cluster<mm_hit>> &old_clusters,
-                   double hit_toa = 0)
+  std::vector<cluster<hit_type>> &
+  get_old_clusters(std::vector<cluster<hit_type>> &old_clusters,
+                   time_type hit_toa = 0)
   {
     // old clusters should be at the end of the list
     while (unfinished_clusters_count_ > 0 &&
            (is_old(hit_toa, unfinished_clusters_.back().cl) || finished_))
     {
-      unfinished_cluster<mm_hit> &current = unfinished_clusters_.back();
-      auto &current_hits = current.cl.hits();
-      for (uint32_t i = 0; i < current.pixel_iterators.size();
-           i++) // update iterator
+      unfinished_cluster<hit_type> &current = unfinished_clusters_.back();
+      // the chunks are flattened to the contiguous hits of the cluster
+      current.cl.hits().reserve(current.hit_count);
+      for (auto &chunk : current.chunks)
       {
-        auto &pixel_list_row =
-            pixel_lists_[current_hits[i].coordinates().linearize(tile_size_)];
-        pixel_list_row.erase(current.pixel_iterators[i]);
+        for (uint32_t i = 0; i < chunk.pixel_iterators.size();
+             i++) // update iterator
+        {
+          auto &pixel_list_row =
+              pixel_lists_[pixel_index(chunk.hits[i].coordinates())];
+          pixel_list_row.erase(chunk.pixel_iterators[i]);
+          if (pixel_list_row.empty())
+            set_occupied(chunk.hits[i].coordinates(), false);
+          current.cl.add_hit(std::move(chunk.hits[i]));
+        }
       }
       current_toa_ = unfinished_clusters_.back().cl.first_toa();
       old_clusters.emplace_back(std::move(unfinished_clusters_.back().cl));
@@ -212,16 +288,19 @@ public:
     return old_clusters;
   }
 
-  void process_hit(mm_hit &&hit)
+  void process_hit(hit_type &&hit)
   {
-    cluster_it target_cluster = unfinished_clusters_.end();
-    const auto neighboring_clusters =
-        find_neighboring_clusters(hit.coordinates(), hit.toa(), target_cluster);
+    cluster_it<hit_type> target_cluster = unfinished_clusters_.end();
+    std::vector<cluster_it<hit_type>> neighboring_clusters;
+    // the pixel lists are searched only if some of them are occupied
+    if (has_occupied_neighbor(hit.coordinates()))
+      neighboring_clusters = find_neighboring_clusters(
+          hit.coordinates(), hit.toa(), target_cluster);
     switch (neighboring_clusters.size())
     {
     case 0:
       // pixel does not belong to any cluster, create a new one
-      unfinished_clusters_.emplace_front(unfinished_cluster<mm_hit>{});
+      unfinished_clusters_.emplace_front(unfinished_cluster<hit_type>{});
       processed_clusters_++;
       unfinished_clusters_.begin()->self = unfinished_clusters_.begin();
       ++unfinished_clusters_count_;
@@ -251,10 +330,10 @@ public:
 
   void process_hits(hit_vect_iterator first, hit_vect_iterator last)
   {
-    std::vector<cluster<mm_hit>> old_clusters;
+    std::vector<cluster<hit_type>> old_clusters;
     for (auto hit_it = first; hit_it != last; ++hit_it)
     {
-      double current_toa = hit_it->toa();
+      time_type current_toa = hit_it->toa();
       process_hit(std::move(*hit_it));
       if (processed_hit_count_ % WRITE_INTERVAL == 0)
         get_old_clusters(old_clusters, current_toa);
@@ -263,10 +342,10 @@ public:
                             old_clusters.end());
   }
 
-  std::vector<cluster<mm_hit>> process_remaining()
+  std::vector<cluster<hit_type>> process_remaining()
   {
     finished_ = true;
-    std::vector<cluster<mm_hit>> old_clusters;
+    std::vector<cluster<hit_type>> old_clusters;
     get_old_clusters(old_clusters);
     std::cout << "Merge happened " << merge_count_ << " times" << std::endl;
     std::cout << "Total hits processed " << processed_hit_count_ << std::endl;
@@ -275,21 +354,23 @@ public:
   }
 
   pixel_list_clusterer(const node_args &args)
-    : pixel_lists_(current_chip::chip_type::size_x() *
-                   current_chip::chip_type::size_y() /
-                   (args.get_arg<int>(name(), "tile_size") *
-                    args.get_arg<int>(name(), "tile_size"))),
+    : unfinished_clusters_count_(0), processed_hit_count_(0), current_toa_(0),
       tile_size_(args.get_arg<int>(name(), "tile_size")),
-      unfinished_clusters_count_(0), processed_hit_count_(0), current_toa_(0),
-      cluster_diff_dt(args.get_arg<double>(name(), "max_dt")),
-      result_clusters_()
+      morton_layout_(args.get_arg<bool>(name(), "morton_layout")),
+      result_clusters_(),
+      cluster_diff_dt(
+          hit_type::from_ns(args.get_arg<double>(name(), "max_dt")))
   {
-    return;
+    pixel_lists_.resize(pixel_list_count());
+    reset_occupancy();
   }
 
-  std::vector<cluster<mm_hit>> &result_clusters() { return result_clusters_; }
+  std::vector<cluster<hit_type>> &result_clusters()
+  {
+    return result_clusters_;
+  }
 
-  double current_toa() { return current_toa_; }
+  time_type current_toa() { return current_toa_; }
 
   void reset()
   {
@@ -297,6 +378,7 @@ public:
     unfinished_clusters_.clear();
     unfinished_clusters_count_ = 0;
     finished_ = false;
+    reset_occupancy();
   }
 
   void set_tile(uint32_t tile_size)
@@ -304,9 +386,7 @@ public:
 
     tile_size_ = tile_size;
     reset();
-    pixel_lists_ = std::vector<cluster_it_list>(
-        current_chip::chip_type::size_x() * current_chip::chip_type::size_y() /
-        (tile_size * tile_size));
+    pixel_lists_ = std::vector<cluster_it_list<hit_type>>(pixel_list_count());
   }
 
   void close() {}
@@ -1,24 +1,226 @@
 #pragma once
 #include "../data_structs/burda_hit.h"
+#include "../data_structs/node_args.h"
+#include "raw_data_reader.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
-// a node which reads the data from a stream using >> operator
+// a node which reads the data from a stream using >> operator,
+// or parses them directly from the memory if the input is a char buffer
+// or a buffer providing the text in blocks
 template <typename istream_type> class data_reader
 {
 protected:
+  static constexpr bool is_memory_input =
+      std::is_base_of<raw_char_buffer, istream_type>::value;
+  static constexpr bool is_block_input =
+      has_block_access<istream_type>::value && !is_memory_input;
+
+  // not yet parsed part of the text in the memory
+  struct text_cursor
+  {
+    const char *pos;
+    const char *end;
+
+    // skips the white space, returns false at the end of the text
+    bool skip_separators()
+    {
+      while (pos < end && *pos > 0 && *pos <= ' ')
+        ++pos;
+      return pos < end;
+    }
+
+    template <typename number_type> bool parse_number(number_type &number)
+    {
+      skip_separators();
+      auto result = std::from_chars(pos, end, number);
+      pos = result.ptr;
+      return result.ec == std::errc();
+    }
+
+    // parses a single hit, handles the comment lines
+    bool parse_hit(burda_hit &hit)
+    {
+      while (skip_separators() && *pos == '#')
+      {
+        auto line_end =
+            static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+        pos = line_end != nullptr ? line_end + 1 : end;
+      }
+      uint32_t lin_coord;
+      uint64_t toa;
+      short ftoa;
+      int16_t tot;
+      if (!(parse_number(lin_coord) && parse_number(toa) &&
+            parse_number(ftoa) && parse_number(tot)))
+        return false;
+      hit = burda_hit(lin_coord, toa, ftoa, tot);
+      return true;
+    }
+
+    // parses and appends all hits, returns false if the text is not valid
+    // till the end
+    bool parse_hits(std::vector<burda_hit> &hits)
+    {
+      burda_hit hit;
+      while (parse_hit(hit))
+        hits.emplace_back(hit);
+      return !skip_separators();
+    }
+  };
+
   // uint64_t total_hits_read_;
   std::unique_ptr<istream_type> input_stream_;
   bool done_ = false;
+  // number of hits read at once by process_hits
+  const uint32_t BLOCK_HIT_COUNT = 1 << 14;
+  // size of the text parsed by a single thread at once
+  const uint64_t CHUNK_BYTE_SIZE = 1 << 22;
+  // smaller chunks of a block are not worth a thread
+  const uint64_t MIN_CHUNK_BYTE_SIZE = 1 << 16;
+  uint32_t thread_count_;
+  text_cursor text_{nullptr, nullptr};
+  std::vector<text_cursor> chunks_;
+  std::vector<std::vector<burda_hit>> chunk_hits_;
+  // incomplete last line of the previous block
+  std::string carry_;
+  bool first_block_ = true;
+  bool block_input_end_ = false;
+  // hits of the last block returned one by one by process_hit
+  std::vector<burda_hit> pending_hits_;
+  uint64_t pending_index_ = 0;
+
+  // the whole input is accessed at once, only the header is skipped
+  void open_memory_input()
+  {
+    const char *text = nullptr;
+    uint64_t size = input_stream_->read_block(
+        text, std::numeric_limits<uint64_t>::max());
+    text_ = text_cursor{text, text + size};
+    const char bom[] = {'\xEF', '\xBB', '\xBF'};
+    if (size >= sizeof(bom) && std::memcmp(text, bom, sizeof(bom)) == 0)
+      text_.pos += sizeof(bom);
+  }
+
+  // splits the next part of the text to line aligned chunks
+  void split_chunks(uint64_t chunk_byte_size)
+  {
+    chunks_.clear();
+    while (chunks_.size() < thread_count_ && text_.pos < text_.end)
+    {
+      const char *chunk_end = text_.end;
+      if (uint64_t(text_.end - text_.pos) > chunk_byte_size)
+      {
+        auto line_end = static_cast<const char *>(
+            std::memchr(text_.pos + chunk_byte_size, '\n',
+                        text_.end - text_.pos - chunk_byte_size));
+        if (line_end != nullptr)
+          chunk_end = line_end + 1;
+      }
+      chunks_.push_back(text_cursor{text_.pos, chunk_end});
+      text_.pos = chunk_end;
+    }
+  }
+
+  // parses the chunks in parallel, the hits keep the order of the input,
+  // returns false if the text is not valid
+  bool parse_chunks(std::vector<burda_hit> &hits,
+                    uint64_t chunk_byte_size)
+  {
+    split_chunks(chunk_byte_size);
+    chunk_hits_.resize(chunks_.size());
+    for (auto &hits_of_chunk : chunk_hits_)
+      hits_of_chunk.clear();
+    std::vector<char> chunk_complete(chunks_.size(), false);
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < chunks_.size(); ++i)
+      workers.emplace_back(
+          [this, i, &chunk_complete]()
+          { chunk_complete[i] = chunks_[i].parse_hits(chunk_hits_[i]); });
+    if (!chunks_.empty())
+      chunk_complete[0] = chunks_[0].parse_hits(chunk_hits_[0]);
+    for (auto &worker : workers)
+      worker.join();
+
+    for (uint32_t i = 0; i < chunks_.size(); ++i)
+    {
+      hits.insert(hits.end(), chunk_hits_[i].begin(), chunk_hits_[i].end());
+      // invalid text ends the input, as in the sequential parsing
+      if (!chunk_complete[i])
+        return false;
+    }
+    return true;
+  }
+
+  // parses the next block of the text, the line split by the end of the
+  // block is completed by the following block,
+  // returns false at the end of the input
+  bool parse_block(std::vector<burda_hit> &hits)
+  {
+    const char *block = nullptr;
+    uint64_t size =
+        input_stream_->read_block(block, std::numeric_limits<uint64_t>::max());
+    if (size == 0)
+    {
+      text_cursor last_line{carry_.data(), carry_.data() + carry_.size()};
+      last_line.parse_hits(hits);
+      return false;
+    }
+    const char *block_end = block + size;
+    const char bom[] = {'\xEF', '\xBB', '\xBF'};
+    if (first_block_ && size >= sizeof(bom) &&
+        std::memcmp(block, bom, sizeof(bom)) == 0)
+      block += sizeof(bom);
+    first_block_ = false;
+
+    auto first_line_end =
+        static_cast<const char *>(std::memchr(block, '\n', block_end - block));
+    if (first_line_end == nullptr)
+    {
+      carry_.append(block, block_end);
+      return true;
+    }
+    carry_.append(block, first_line_end + 1);
+    text_cursor first_line{carry_.data(), carry_.data() + carry_.size()};
+    if (!first_line.parse_hits(hits))
+      return false;
+    const char *last_line_end = block_end - 1;
+    while (*last_line_end != '\n')
+      --last_line_end;
+    text_ = text_cursor{first_line_end + 1, last_line_end + 1};
+    // the block is shared by all threads, as the blocks are usually not
+    // larger than the chunks of the memory input
+    const uint64_t chunk_byte_size = std::max(
+        MIN_CHUNK_BYTE_SIZE,
+        (uint64_t(text_.end - text_.pos) + thread_count_ - 1) / thread_count_);
+    while (text_.pos < text_.end)
+      if (!parse_chunks(hits, chunk_byte_size))
+        return false;
+    carry_.assign(last_line_end + 1, block_end);
+    return true;
+  }
 
 public:
-  data_reader(const std::string &file_name)
-    : input_stream_(std::move(std::make_unique<istream_type>(file_name)))
+  data_reader(const std::string &file_name, const node_args &args = node_args())
+    : input_stream_(std::move(std::make_unique<istream_type>(file_name))),
+      thread_count_(args.get_arg<int>(name(), "parse_thread_count"))
 
   {
+    if (thread_count_ == 0)
+      thread_count_ = std::max(1U, std::thread::hardware_concurrency());
     check_input_stream(file_name);
+    if constexpr (is_memory_input)
+      open_memory_input();
     auto istream_optional = dynamic_cast<std::istream *>(input_stream_.get());
     if (istream_optional != nullptr)
     {
@@ -45,9 +247,52 @@ public:
   burda_hit process_hit()
   {
     burda_hit data;
-    *input_stream_ >> data;
+    if constexpr (is_memory_input)
+    {
+      if (!text_.parse_hit(data))
+        data = burda_hit::end_token();
+    }
+    else if constexpr (is_block_input)
+    {
+      while (pending_index_ == pending_hits_.size() && !block_input_end_)
+      {
+        pending_hits_.clear();
+        pending_index_ = 0;
+        block_input_end_ = !parse_block(pending_hits_);
+      }
+      data = pending_index_ < pending_hits_.size()
+                 ? pending_hits_[pending_index_++]
+                 : burda_hit::end_token();
+    }
+    else
+      *input_stream_ >> data;
     if (!data.is_valid())
       done_ = true;
     return data;
   }
+
+  // replaces the content of hits by the next block of hits
+  void process_hits(std::vector<burda_hit> &hits)
+  {
+    hits.clear();
+    if constexpr (is_memory_input)
+    {
+      if (!parse_chunks(hits, CHUNK_BYTE_SIZE) || text_.pos == text_.end)
+        done_ = true;
+      return;
+    }
+    else if constexpr (is_block_input)
+    {
+      if (!parse_block(hits))
+        done_ = true;
+      return;
+    }
+    while (hits.size() < BLOCK_HIT_COUNT)
+    {
+      burda_hit hit = process_hit();
+      if (done_)
+        return;
+      hits.emplace_back(hit);
+    }
+  }
 };
@@ -0,0 +1,257 @@
+#pragma once
+#include "../data_structs/node_args.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// sorts arbitrarily unordered datastreams in bounded memory, the hits are
+// sorted in runs which fit the memory budget, the runs are spilled to
+// temporary files and merged once the datastream ends
+template <typename data_type> class external_sorter
+{
+  static_assert(std::is_trivially_copyable<data_type>::value,
+                "the hits are spilled to the files as raw bytes");
+  using time_type = typename data_type::time_type;
+  using file_pointer = std::unique_ptr<std::FILE, int (*)(std::FILE *)>;
+
+  // a sorted run, either spilled to a file or kept in the memory
+  struct run
+  {
+    file_pointer file{nullptr, std::fclose};
+    // hits of the file which were not read yet
+    uint64_t unread_count = 0;
+    std::vector<data_type> block;
+    uint64_t position = 0;
+    // number of the merges the hits of the run went through
+    uint32_t level = 0;
+  };
+
+  // the heap entries, the run with the earliest next hit is on top
+  using run_head = std::pair<time_type, uint32_t>;
+  // number of merged hits passed on at once
+  static constexpr uint32_t MERGE_BLOCK_HIT_COUNT = 1 << 14;
+  // minimal number of hits read from a run at once
+  static constexpr uint32_t MIN_READ_HIT_COUNT = 1 << 8;
+  // the spilled runs of a level are merged to a single run of the next level
+  // once there are this many of them, which bounds the number of the open
+  // temporary files while each hit is rewritten only once per level
+  static constexpr uint32_t MAX_RUN_COUNT = 64;
+
+  uint64_t memory_budget_;
+  // the hits of the run being collected
+  std::vector<data_type> buffer_;
+  std::vector<run> runs_;
+  std::priority_queue<run_head, std::vector<run_head>, std::greater<run_head>>
+      run_heads_;
+  uint64_t read_hit_count_ = 0;
+  bool merging_ = false;
+  std::vector<data_type> result_hits_;
+
+  void sort_buffer()
+  {
+    std::sort(buffer_.begin(), buffer_.end(),
+              [](const data_type &left, const data_type &right)
+              { return left.time() < right.time(); });
+  }
+
+  static run create_spilled_run()
+  {
+    run spilled;
+    spilled.file = file_pointer(std::tmpfile(), std::fclose);
+    if (!spilled.file)
+      throw std::runtime_error("Spilling of the sorted hits failed");
+    return spilled;
+  }
+
+  static void write_hits(run &spilled, const std::vector<data_type> &hits)
+  {
+    if (std::fwrite(hits.data(), sizeof(data_type), hits.size(),
+                    spilled.file.get()) != hits.size())
+      throw std::runtime_error("Spilling of the sorted hits failed");
+    spilled.unread_count += hits.size();
+  }
+
+  // moves the written run to the runs so it can be read
+  void add_spilled_run(run &&spilled)
+  {
+    if (std::fseek(spilled.file.get(), 0, SEEK_SET) != 0)
+      throw std::runtime_error("Spilling of the sorted hits failed");
+    runs_.emplace_back(std::move(spilled));
+  }
+
+  void spill_buffer()
+  {
+    sort_buffer();
+    run spilled = create_spilled_run();
+    write_hits(spilled, buffer_);
+    add_spilled_run(std::move(spilled));
+    buffer_.clear();
+    // the levels of the runs never increase towards the end, so the runs of
+    // the lowest level are the last ones
+    while (runs_.size() >= MAX_RUN_COUNT &&
+           runs_[runs_.size() - MAX_RUN_COUNT].level == runs_.back().level)
+      merge_spilled_runs(runs_.size() - MAX_RUN_COUNT);
+  }
+
+  // merges the spilled runs from the first index to a new spilled run
+  void merge_spilled_runs(uint64_t first_run)
+  {
+    // the memory of the buffer is given to the read blocks meanwhile
+    buffer_ = std::vector<data_type>();
+    open_runs(memory_budget_ / sizeof(data_type), first_run);
+    run merged = create_spilled_run();
+    merged.level = runs_[first_run].level + 1;
+    std::vector<data_type> hits;
+    while (merge_block(hits))
+      write_hits(merged, hits);
+    runs_.erase(runs_.begin() + first_run, runs_.end());
+    add_spilled_run(std::move(merged));
+  }
+
+  // refills the block of the run, returns false if the run is exhausted
+  bool read_block(run &source)
+  {
+    source.position = 0;
+    source.block.clear();
+    if (source.unread_count == 0)
+      return false;
+    source.block.resize(std::min(source.unread_count, read_hit_count_));
+    if (std::fread(source.block.data(), sizeof(data_type),
+                   source.block.size(),
+                   source.file.get()) != source.block.size())
+      throw std::runtime_error("Reading of the sorted hits failed");
+    source.unread_count -= source.block.size();
+    return true;
+  }
+
+  // reads the first blocks of the runs from the first index, the spilled
+  // runs share the budget
+  void open_runs(uint64_t budget_hit_count, uint64_t first_run = 0)
+  {
+    const uint64_t spilled_count =
+        std::count_if(runs_.begin() + first_run, runs_.end(),
+                      [](const run &source) { return bool(source.file); });
+    read_hit_count_ = std::max<uint64_t>(
+        MIN_READ_HIT_COUNT,
+        budget_hit_count / std::max<uint64_t>(spilled_count, 1));
+    for (uint64_t i = first_run; i < runs_.size(); ++i)
+    {
+      if (runs_[i].file)
+        read_block(runs_[i]);
+      if (!runs_[i].block.empty())
+        run_heads_.emplace(runs_[i].block.front().time(), i);
+    }
+  }
+
+  void start_merging()
+  {
+    merging_ = true;
+    // the smallest runs are merged first, so the final merge opens at most
+    // MAX_RUN_COUNT files as well, the last run is spilled then too
+    if (runs_.size() + (buffer_.empty() ? 0 : 1) > MAX_RUN_COUNT)
+    {
+      if (!buffer_.empty())
+        spill_buffer();
+      if (runs_.size() > MAX_RUN_COUNT)
+        merge_spilled_runs(MAX_RUN_COUNT - 1);
+    }
+    uint64_t budget_hit_count = memory_budget_ / sizeof(data_type);
+    if (!buffer_.empty())
+    {
+      // the last run is merged directly from the memory, so the read blocks
+      // get only the rest of the budget
+      sort_buffer();
+      budget_hit_count -= std::min<uint64_t>(budget_hit_count, buffer_.size());
+      runs_.emplace_back();
+      runs_.back().block = std::move(buffer_);
+      buffer_ = std::vector<data_type>();
+    }
+    open_runs(budget_hit_count);
+  }
+
+  // replaces the content of hits by the next merged hits of the open runs,
+  // returns false when all hits were merged
+  bool merge_block(std::vector<data_type> &hits)
+  {
+    hits.clear();
+    while (!run_heads_.empty() && hits.size() < MERGE_BLOCK_HIT_COUNT)
+    {
+      const uint32_t run_index = run_heads_.top().second;
+      run_heads_.pop();
+      run &source = runs_[run_index];
+      hits.emplace_back(source.block[source.position++]);
+      if (source.position == source.block.size() && !read_block(source))
+      {
+        // release the memory and the file of the exhausted run
+        source = run();
+        continue;
+      }
+      run_heads_.emplace(source.block[source.position].time(), run_index);
+    }
+    return !hits.empty();
+  }
+
+public:
+  std::vector<data_type> &result_hits() { return result_hits_; }
+
+  external_sorter(const node_args &args = node_args())
+    : memory_budget_(
+          std::stoull(args.get_arg<std::string>(name(), "memory_budget"))),
+      result_hits_()
+  {
+    if (memory_budget_ < sizeof(data_type))
+      throw std::invalid_argument("The memory_budget of '" + name() +
+                                  "' does not fit a single hit");
+  }
+
+  std::string name() { return "external_sorter"; }
+
+  // the number of runs spilled to the temporary files
+  uint64_t spilled_run_count() const
+  {
+    return std::count_if(runs_.begin(), runs_.end(),
+                         [](const run &source) { return bool(source.file); });
+  }
+
+  void process_hit(data_type &&hit)
+  {
+    buffer_.emplace_back(std::move(hit));
+    if (buffer_.size() * sizeof(data_type) >= memory_budget_)
+      spill_buffer();
+  }
+
+  // processes a block of hits, the content of the block is moved
+  void process_hits(std::vector<data_type> &hits)
+  {
+    for (auto &hit : hits)
+      process_hit(std::move(hit));
+    hits.clear();
+  }
+
+  // replaces the content of hits by the next merged hits once the datastream
+  // ended, returns false when all hits were merged
+  bool merge_next(std::vector<data_type> &hits)
+  {
+    if (!merging_)
+      start_merging();
+    return merge_block(hits);
+  }
+
+  std::vector<data_type> process_remaining()
+  {
+    // merge all hits at the end of datastream
+    std::vector<data_type> hits;
+    while (merge_next(hits))
+      result_hits_.insert(result_hits_.end(), hits.begin(), hits.end());
+    return result_hits_;
+  }
+
+  virtual ~external_sorter() = default;
+};
@@ -1,80 +1,150 @@
 #pragma once
 #include "../data_structs/burda_hit.h"
+#include "../data_structs/node_args.h"
 #include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
 #include <queue>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 // uses heap sorting (priority queue) to guarantee temporal orderedness of hits
 template <typename data_type> class hit_sorter
 {
-  // sorts mm hits temporally
+  // sorts the hits temporally, burda hits by their integer fast clock ticks
   struct toa_comparer
   {
     auto operator()(const data_type &left, const data_type &right) const
     {
-      if (left.toa() < right.toa())
+      if (left.time() < right.time())
         return false;
-      if (right.toa() < left.toa())
-        return true;
-      return false;
-    }
-  };
-
-  // for sorting burda hits temporally
-  struct burda_toa_comparer
-  {
-    auto operator()(const burda_hit &left, const burda_hit &right) const
-    {
-      if (left.toa() < right.toa())
-        return false;
-      if (right.toa() < left.toa())
-        return true;
-      if (left.fast_toa() < right.fast_toa())
-        return false;
-      if (right.fast_toa() < left.fast_toa())
+      if (right.time() < left.time())
         return true;
       return false;
     }
   };
 
+  using time_type = typename data_type::time_type;
   using hits_optional_type = std::optional<std::vector<data_type>>;
   std::priority_queue<data_type, std::vector<data_type>, toa_comparer>
       priority_queue_;
-  // maximal unorderedness of the datastream
-  const double DEQUEUE_TIME = 500000.;
+  // maximal unorderedness of the datastream, the hits are held this long
+  time_type dequeue_time_;
+  // the adaptive window follows the measured unorderedness within the bounds
+  bool adaptive_;
+  time_type min_dequeue_time_;
+  time_type max_dequeue_time_;
+  double dequeue_time_margin_;
+  // the largest backward jump of ToA in the current and previous epoch
+  time_type epoch_max_delay_ = 0;
+  time_type previous_epoch_max_delay_ = 0;
+  time_type newest_toa_ = std::numeric_limits<time_type>::lowest();
+  // the delays are measured over epochs of EPOCH_HIT_COUNT hits
+  const uint32_t EPOCH_HIT_COUNT = 1 << 16;
   // check for outputting the hits every DEQUEUE_CHECK_INTERVAL hits
   const uint32_t DEQUEUE_CHECK_INTERVAL = 64;
   uint64_t processed_hit_count_;
+  // hits which arrived after the hits following them were already dequeued
+  time_type last_dequeued_toa_ = std::numeric_limits<time_type>::lowest();
+  uint64_t late_hit_count_ = 0;
+  time_type max_late_delay_ = 0;
   std::vector<data_type> result_hits_;
 
+  void update_dequeue_time(time_type delay)
+  {
+    if (delay > epoch_max_delay_)
+    {
+      epoch_max_delay_ = delay;
+      // grow as soon as the window becomes too short
+      dequeue_time_ = std::max(dequeue_time_, window_for(delay));
+    }
+    if (processed_hit_count_ % EPOCH_HIT_COUNT == 0)
+    {
+      // shrink once the delays stay shorter for a whole epoch
+      dequeue_time_ = window_for(
+          std::max(epoch_max_delay_, previous_epoch_max_delay_));
+      previous_epoch_max_delay_ = epoch_max_delay_;
+      epoch_max_delay_ = 0;
+    }
+  }
+
+  time_type window_for(time_type delay) const
+  {
+    return std::clamp(time_type(dequeue_time_margin_ * delay),
+                      min_dequeue_time_, max_dequeue_time_);
+  }
+
 public:
   std::vector<data_type> &result_hits() { return result_hits_; }
 
-  hit_sorter() : result_hits_()
+  hit_sorter(const node_args &args = node_args())
+    : dequeue_time_(
+          data_type::from_ns(args.get_arg<double>(name(), "dequeue_time"))),
+      adaptive_(args.get_arg<bool>(name(), "adaptive_dequeue")),
+      min_dequeue_time_(data_type::from_ns(
+          args.get_arg<double>(name(), "min_dequeue_time"))),
+      max_dequeue_time_(dequeue_time_),
+      dequeue_time_margin_(args.get_arg<double>(name(), "dequeue_time_margin")),
+      processed_hit_count_(0), result_hits_()
   {
     toa_comparer less_comparer;
     priority_queue_ =
         std::priority_queue<data_type, std::vector<data_type>, toa_comparer>(
             less_comparer);
+    if (adaptive_ && min_dequeue_time_ > max_dequeue_time_)
+      throw std::invalid_argument(
+          "The min_dequeue_time of '" + name() +
+          "' must not be greater than its dequeue_time");
+    if (adaptive_)
+      dequeue_time_ = min_dequeue_time_;
   }
 
   std::string name() { return "hit_sorter"; }
 
+  // the current time the hits are held for
+  time_type dequeue_time() const { return dequeue_time_; }
+
+  uint64_t late_hit_count() const { return late_hit_count_; }
+
+  time_type max_late_delay() const { return max_late_delay_; }
+
   void process_hit(data_type &&hit)
   {
-    priority_queue_.push(hit);
+    if (hit.time() < last_dequeued_toa_)
+    {
+      ++late_hit_count_;
+      max_late_delay_ = std::max(max_late_delay_,
+                                 time_type(last_dequeued_toa_ - hit.time()));
+    }
     ++processed_hit_count_;
+    if (adaptive_)
+    {
+      newest_toa_ = std::max(newest_toa_, hit.time());
+      update_dequeue_time(newest_toa_ - hit.time());
+    }
+    priority_queue_.push(hit);
     if (processed_hit_count_ % DEQUEUE_CHECK_INTERVAL == 0)
     {
-      while (priority_queue_.top().toa() < hit.toa() - DEQUEUE_TIME)
+      while (priority_queue_.top().time() < hit.time() - dequeue_time_)
       {
         data_type old_hit = priority_queue_.top();
+        last_dequeued_toa_ = old_hit.time();
         result_hits_.emplace_back(std::move(old_hit));
         priority_queue_.pop();
       }
     }
   }
 
+  // processes a block of hits, the content of the block is moved
+  void process_hits(std::vector<data_type> &hits)
+  {
+    for (auto &hit : hits)
+      process_hit(std::move(hit));
+    hits.clear();
+  }
+
   std::vector<data_type> process_remaining()
   {
     std::vector<data_type> hits;
@@ -85,6 +155,9 @@ public:
       priority_queue_.pop();
       result_hits_.emplace_back(std::move(old_hit));
     }
+    if (late_hit_count_ > 0)
+      std::cout << "Late hits " << late_hit_count_ << ", max delay "
+                << data_type::to_ns(max_late_delay_) << " ns" << std::endl;
     return result_hits_;
   }
 
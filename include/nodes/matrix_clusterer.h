@@ -0,0 +1,281 @@
+#pragma once
+#include "../data_structs/cluster.h"
+#include "../data_structs/mm_hit.h"
+#include "../data_structs/node_args.h"
+#include "../devices/current_device.h"
+#include "../other/utils.h"
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+// a node which implements the pixel list clustering with a dense matrix which
+// holds the cluster of the newest hit of each pixel, the clusters are
+// merged by a union of their ids in a union-find forest, so no hits are moved
+// until the cluster is finished
+template <typename hit_type = mm_hit> class matrix_clusterer
+{
+  using time_type = typename hit_type::time_type;
+  using hit_vect_iterator = typename std::vector<hit_type>::iterator;
+  static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+  // a cluster id, the ids of the merged clusters form a tree whose root
+  // holds the statistics of the merged cluster
+  struct cluster_node
+  {
+    uint32_t parent;
+    // the members of the merged cluster are linked in a cycle
+    uint32_t next_member;
+    // the hits added while the id was the root
+    std::vector<hit_type> hits;
+    // valid for the roots only
+    uint32_t hit_count;
+    time_type first_toa;
+    time_type last_toa;
+    bool selected;
+    bool closed;
+  };
+
+  std::vector<cluster_node> nodes_;
+  std::vector<uint32_t> free_ids_;
+  // the cluster id of the newest hit of each pixel
+  std::vector<uint32_t> pixel_matrix_;
+  // ids of the unfinished clusters in the order of their creation
+  std::deque<uint32_t> open_ids_;
+  bool finished_ = false;
+  uint64_t processed_hit_count_ = 0;
+  time_type current_toa_ = 0;
+  uint32_t tile_size_;
+  const std::array<coord, 9> EIGHT_NEIGHBORS = {
+      {{-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 0}, {0, 1}, {1, -1}, {1, 0},
+       {1, 1}}};
+  const uint32_t WRITE_INTERVAL = 2 << 2;
+  uint64_t merge_count_ = 0;
+  std::vector<cluster<hit_type>> result_clusters_;
+  uint64_t processed_clusters_ = 0;
+  // time that marks the max difference of cluster last_toa()
+  time_type cluster_diff_dt;
+
+  uint32_t create_cluster()
+  {
+    uint32_t id;
+    if (free_ids_.empty())
+    {
+      id = nodes_.size();
+      nodes_.emplace_back();
+    }
+    else
+    {
+      id = free_ids_.back();
+      free_ids_.pop_back();
+    }
+    cluster_node &created = nodes_[id];
+    created.parent = id;
+    created.next_member = id;
+    created.hit_count = 0;
+    created.first_toa = std::numeric_limits<time_type>::max();
+    created.last_toa = std::numeric_limits<time_type>::lowest();
+    created.selected = false;
+    created.closed = false;
+    open_ids_.push_back(id);
+    return id;
+  }
+
+  uint32_t find_root(uint32_t id)
+  {
+    // path halving
+    while (nodes_[id].parent != id)
+    {
+      nodes_[id].parent = nodes_[nodes_[id].parent].parent;
+      id = nodes_[id].parent;
+    }
+    return id;
+  }
+
+  // joins two roots, returns the new root
+  uint32_t unite(uint32_t left, uint32_t right)
+  {
+    if (nodes_[left].hit_count < nodes_[right].hit_count)
+      std::swap(left, right);
+    cluster_node &root = nodes_[left];
+    cluster_node &child = nodes_[right];
+    child.parent = left;
+    std::swap(root.next_member, child.next_member);
+    root.hit_count += child.hit_count;
+    root.first_toa = std::min(root.first_toa, child.first_toa);
+    root.last_toa = std::max(root.last_toa, child.last_toa);
+    return left;
+  }
+
+  bool is_old(time_type last_toa, const cluster_node &cl)
+  {
+    return cl.last_toa < last_toa - cluster_diff_dt;
+  }
+
+  // stores the roots of the clusters neighboring the hit to neighbors,
+  // returns the number of the roots
+  uint32_t find_neighboring_clusters(const coord &base_coord, time_type toa,
+                                     std::array<uint32_t, 9> &neighbors)
+  {
+    uint32_t neighbor_count = 0;
+    for (const auto &neighbor_offset : EIGHT_NEIGHBORS)
+    {
+      if (!base_coord.is_valid_neighbor(neighbor_offset, tile_size_))
+        continue;
+      const uint32_t id =
+          pixel_matrix_[neighbor_offset.linearize_tiled(tile_size_) +
+                        base_coord.linearize(tile_size_)];
+      if (id == NONE)
+        continue;
+      const uint32_t root = find_root(id);
+      cluster_node &neighbor = nodes_[root];
+      if (std::abs(toa - neighbor.last_toa) < cluster_diff_dt &&
+          !neighbor.selected)
+      {
+        neighbor.selected = true;
+        neighbors[neighbor_count++] = root;
+      }
+    }
+    for (uint32_t i = 0; i < neighbor_count; ++i)
+      nodes_[neighbors[i]].selected = false;
+    return neighbor_count;
+  }
+
+  // gathers the hits of all members of the cluster to a finished cluster
+  void finish_cluster(uint32_t root,
+                      std::vector<cluster<hit_type>> &old_clusters)
+  {
+    current_toa_ = nodes_[root].first_toa;
+    old_clusters.emplace_back();
+    auto &result = old_clusters.back();
+    result.hits().reserve(nodes_[root].hit_count);
+    uint32_t member = root;
+    do
+    {
+      cluster_node &node = nodes_[member];
+      for (auto &hit : node.hits)
+      {
+        // the pixel may already hold a hit of a newer cluster
+        uint32_t &pixel =
+            pixel_matrix_[hit.coordinates().linearize(tile_size_)];
+        if (pixel == member)
+          pixel = NONE;
+        result.add_hit(std::move(hit));
+      }
+      // the capacity of the hits is kept for the reuse of the id
+      node.hits.clear();
+      node.closed = true;
+      member = node.next_member;
+    } while (member != root);
+  }
+
+public:
+  std::string name() { return "matrix_clusterer"; }
+
+  std::vector<cluster<hit_type>> &
+  get_old_clusters(std::vector<cluster<hit_type>> &old_clusters,
+                   time_type hit_toa = 0)
+  {
+    // the ids are released in the order of their creation, the ids of the
+    // merged clusters are released once they get to the front
+    while (!open_ids_.empty())
+    {
+      const uint32_t id = open_ids_.front();
+      if (!nodes_[id].closed)
+      {
+        const uint32_t root = find_root(id);
+        if (!is_old(hit_toa, nodes_[root]) && !finished_)
+          break;
+        finish_cluster(root, old_clusters);
+      }
+      open_ids_.pop_front();
+      free_ids_.push_back(id);
+    }
+    return old_clusters;
+  }
+
+  void process_hit(hit_type &&hit)
+  {
+    std::array<uint32_t, 9> neighbors;
+    const uint32_t neighbor_count =
+        find_neighboring_clusters(hit.coordinates(), hit.toa(), neighbors);
+    uint32_t target_cluster;
+    switch (neighbor_count)
+    {
+    case 0:
+      // pixel does not belong to any cluster, create a new one
+      target_cluster = create_cluster();
+      processed_clusters_++;
+      break;
+    case 1:
+      target_cluster = neighbors[0];
+      break;
+    default:
+      // the clusters are only united, their hits stay in place
+      ++merge_count_;
+      target_cluster = neighbors[0];
+      for (uint32_t i = 1; i < neighbor_count; ++i)
+      {
+        target_cluster = unite(target_cluster, neighbors[i]);
+        processed_clusters_--;
+      }
+      break;
+    }
+    cluster_node &target = nodes_[target_cluster];
+    ++target.hit_count;
+    target.first_toa = std::min(target.first_toa, hit.toa());
+    target.last_toa = std::max(target.last_toa, hit.toa());
+    pixel_matrix_[hit.coordinates().linearize(tile_size_)] = target_cluster;
+    target.hits.emplace_back(std::move(hit));
+    ++processed_hit_count_;
+  }
+
+  void process_hits(hit_vect_iterator first, hit_vect_iterator last)
+  {
+    for (auto hit_it = first; hit_it != last; ++hit_it)
+    {
+      time_type current_toa = hit_it->toa();
+      process_hit(std::move(*hit_it));
+      if (processed_hit_count_ % WRITE_INTERVAL == 0)
+        get_old_clusters(result_clusters_, current_toa);
+    }
+  }
+
+  std::vector<cluster<hit_type>> process_remaining()
+  {
+    finished_ = true;
+    std::vector<cluster<hit_type>> old_clusters;
+    get_old_clusters(old_clusters);
+    std::cout << "Merge happened " << merge_count_ << " times" << std::endl;
+    std::cout << "Total hits processed " << processed_hit_count_ << std::endl;
+    std::cout << "Processed clusters " << processed_clusters_ << std::endl;
+    return old_clusters;
+  }
+
+  matrix_clusterer(const node_args &args)
+    : pixel_matrix_(current_chip::chip_type::size_x() *
+                        current_chip::chip_type::size_y() /
+                        (args.get_arg<int>(name(), "tile_size") *
+                         args.get_arg<int>(name(), "tile_size")),
+                    NONE),
+      tile_size_(args.get_arg<int>(name(), "tile_size")),
+      cluster_diff_dt(
+          hit_type::from_ns(args.get_arg<double>(name(), "max_dt")))
+  {
+  }
+
+  std::vector<cluster<hit_type>> &result_clusters()
+  {
+    return result_clusters_;
+  }
+
+  time_type current_toa() { return current_toa_; }
+
+  void close() {}
+
+  virtual ~matrix_clusterer() = default;
+};
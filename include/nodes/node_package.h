@@ -1,9 +1,14 @@
 #pragma once
+#include "batch_sorter.h"
 #include "clusterer.h"
 #include "hit_sorter.h"
+#include "matrix_clusterer.h"
+#include "pooled_clusterer.h"
 // #include "online_data_reader.h"
 #include "burda_to_mm_hit_adapter.h"
 #include "cluster_splitter.h"
 #include "data_printer.h"
 #include "data_reader.h"
-#include "temporal_clusterer.h"
\ No newline at end of file
+#include "external_sorter.h"
+#include "temporal_clusterer.h"
+#include "time_wheel_sorter.h"
\ No newline at end of file
@@ -0,0 +1,355 @@
+#pragma once
+#include "../data_structs/cluster.h"
+#include "../data_structs/mm_hit.h"
+#include "../data_structs/node_args.h"
+#include "../devices/current_device.h"
+#include "../other/utils.h"
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+// the pixel list clustering of pixel_list_clusterer, the clusters and the
+// entries of the pixel lists are stored in pools addressed by 32 bit indices
+// and linked intrusively, so no memory is allocated once the pools are large
+// enough (except for the hits of the finished clusters)
+template <typename hit_type = mm_hit> class pooled_pixel_list_clusterer
+{
+  using time_type = typename hit_type::time_type;
+  using hit_vect_iterator = typename std::vector<hit_type>::iterator;
+  static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+  // a hit of an unfinished cluster, it is linked both in the list of its
+  // pixel and in the list of the hits of its cluster
+  struct hit_entry
+  {
+    hit_type hit;
+    uint32_t cluster;
+    // neighbors in the list of the pixel, the newest entry is the first
+    uint32_t pixel_previous;
+    uint32_t pixel_next;
+    // the next hit of the cluster, links the free entries as well
+    uint32_t cluster_next;
+  };
+
+  struct cluster_entry
+  {
+    time_type first_toa;
+    time_type last_toa;
+    uint32_t first_hit;
+    uint32_t last_hit;
+    uint32_t hit_count;
+    // neighbors in the list of unfinished clusters, the newest is the first,
+    // next links the free entries as well
+    uint32_t previous;
+    uint32_t next;
+    bool selected;
+  };
+
+  std::vector<hit_entry> hit_pool_;
+  std::vector<cluster_entry> cluster_pool_;
+  uint32_t free_hit_ = NONE;
+  uint32_t free_cluster_ = NONE;
+  // the newest hit entry of each pixel
+  std::vector<uint32_t> pixel_heads_;
+  uint32_t newest_cluster_ = NONE;
+  uint32_t oldest_cluster_ = NONE;
+  uint32_t unfinished_clusters_count_ = 0;
+  bool finished_ = false;
+  uint64_t processed_hit_count_ = 0;
+  time_type current_toa_ = 0;
+  uint32_t tile_size_;
+  const std::array<coord, 9> EIGHT_NEIGHBORS = {
+      {{-1, -1}, {-1, 0}, {-1, 1}, {0, -1}, {0, 0}, {0, 1}, {1, -1}, {1, 0},
+       {1, 1}}};
+  const uint32_t WRITE_INTERVAL = 2 << 2;
+  uint64_t merge_count_ = 0;
+  std::vector<cluster<hit_type>> result_clusters_;
+  uint64_t processed_clusters_ = 0;
+  // time that marks the max difference of cluster last_toa()
+  time_type cluster_diff_dt;
+
+  uint32_t allocate_hit()
+  {
+    if (free_hit_ == NONE)
+    {
+      hit_pool_.emplace_back();
+      return hit_pool_.size() - 1;
+    }
+    uint32_t index = free_hit_;
+    free_hit_ = hit_pool_[index].cluster_next;
+    return index;
+  }
+
+  uint32_t allocate_cluster()
+  {
+    if (free_cluster_ == NONE)
+    {
+      cluster_pool_.emplace_back();
+      return cluster_pool_.size() - 1;
+    }
+    uint32_t index = free_cluster_;
+    free_cluster_ = cluster_pool_[index].next;
+    return index;
+  }
+
+  // creates an empty cluster at the front of the unfinished clusters
+  uint32_t create_cluster()
+  {
+    uint32_t index = allocate_cluster();
+    cluster_entry &created = cluster_pool_[index];
+    created.first_toa = std::numeric_limits<time_type>::max();
+    created.last_toa = std::numeric_limits<time_type>::lowest();
+    created.first_hit = NONE;
+    created.last_hit = NONE;
+    created.hit_count = 0;
+    created.previous = NONE;
+    created.next = newest_cluster_;
+    created.selected = false;
+    if (newest_cluster_ != NONE)
+      cluster_pool_[newest_cluster_].previous = index;
+    else
+      oldest_cluster_ = index;
+    newest_cluster_ = index;
+    ++unfinished_clusters_count_;
+    return index;
+  }
+
+  // removes the cluster from the unfinished clusters and frees it
+  void release_cluster(uint32_t index)
+  {
+    cluster_entry &released = cluster_pool_[index];
+    if (released.previous != NONE)
+      cluster_pool_[released.previous].next = released.next;
+    else
+      newest_cluster_ = released.next;
+    if (released.next != NONE)
+      cluster_pool_[released.next].previous = released.previous;
+    else
+      oldest_cluster_ = released.previous;
+    released.next = free_cluster_;
+    free_cluster_ = index;
+    --unfinished_clusters_count_;
+  }
+
+  void unlink_from_pixel(uint32_t index)
+  {
+    hit_entry &entry = hit_pool_[index];
+    if (entry.pixel_previous != NONE)
+      hit_pool_[entry.pixel_previous].pixel_next = entry.pixel_next;
+    else
+      pixel_heads_[entry.hit.coordinates().linearize(tile_size_)] =
+          entry.pixel_next;
+    if (entry.pixel_next != NONE)
+      hit_pool_[entry.pixel_next].pixel_previous = entry.pixel_previous;
+  }
+
+  bool is_old(time_type last_toa, const cluster_entry &cl)
+  {
+    return cl.last_toa < last_toa - cluster_diff_dt;
+  }
+
+  void merge_clusters(uint32_t base_index, uint32_t new_index)
+  {
+    cluster_entry &base_cluster = cluster_pool_[base_index];
+    cluster_entry &new_cluster = cluster_pool_[new_index];
+    for (uint32_t hit = new_cluster.first_hit; hit != NONE;
+         hit = hit_pool_[hit].cluster_next) // update owner
+      hit_pool_[hit].cluster = base_index;
+    // the hits are appended in O(1)
+    hit_pool_[base_cluster.last_hit].cluster_next = new_cluster.first_hit;
+    base_cluster.last_hit = new_cluster.last_hit;
+    base_cluster.hit_count += new_cluster.hit_count;
+    // update first and last toa
+    base_cluster.first_toa =
+        std::min(base_cluster.first_toa, new_cluster.first_toa);
+    base_cluster.last_toa =
+        std::max(base_cluster.last_toa, new_cluster.last_toa);
+    release_cluster(new_index);
+  }
+
+  // stores the clusters neighboring the hit to neighbors, returns the
+  // number of the clusters, oldest_cluster is the one with the lowest
+  // first toa
+  uint32_t find_neighboring_clusters(const coord &base_coord, time_type toa,
+                                     std::array<uint32_t, 9> &neighbors,
+                                     uint32_t &oldest_cluster)
+  {
+    uint32_t neighbor_count = 0;
+    time_type min_toa = std::numeric_limits<time_type>::max();
+    for (const auto &neighbor_offset : EIGHT_NEIGHBORS)
+    {
+      if (!base_coord.is_valid_neighbor(neighbor_offset, tile_size_))
+        continue;
+      uint32_t neighbor_index = neighbor_offset.linearize_tiled(tile_size_) +
+                                base_coord.linearize(tile_size_);
+      for (uint32_t entry = pixel_heads_[neighbor_index]; entry != NONE;
+           entry = hit_pool_[entry].pixel_next)
+      {
+        const uint32_t cluster_index = hit_pool_[entry].cluster;
+        cluster_entry &neighbor = cluster_pool_[cluster_index];
+        if (std::abs(toa - neighbor.last_toa) < cluster_diff_dt &&
+            !neighbor.selected)
+        {
+          neighbor.selected = true;
+          neighbors[neighbor_count++] = cluster_index;
+          if (neighbor.first_toa < min_toa)
+          {
+            min_toa = neighbor.first_toa;
+            oldest_cluster = cluster_index;
+          }
+          break;
+        }
+      }
+    }
+    for (uint32_t i = 0; i < neighbor_count; ++i)
+      cluster_pool_[neighbors[i]].selected = false;
+    return neighbor_count;
+  }
+
+  void add_new_hit(hit_type &&hit, uint32_t cluster_index)
+  {
+    const uint32_t index = allocate_hit();
+    hit_entry &entry = hit_pool_[index];
+    uint32_t &pixel_head =
+        pixel_heads_[hit.coordinates().linearize(tile_size_)];
+    entry.cluster = cluster_index;
+    entry.pixel_previous = NONE;
+    entry.pixel_next = pixel_head;
+    entry.cluster_next = NONE;
+    if (pixel_head != NONE)
+      hit_pool_[pixel_head].pixel_previous = index;
+    pixel_head = index;
+    cluster_entry &target = cluster_pool_[cluster_index];
+    if (target.last_hit == NONE)
+      target.first_hit = index;
+    else
+      hit_pool_[target.last_hit].cluster_next = index;
+    target.last_hit = index;
+    ++target.hit_count;
+    target.first_toa = std::min(target.first_toa, hit.toa());
+    target.last_toa = std::max(target.last_toa, hit.toa());
+    entry.hit = std::move(hit);
+  }
+
+  // moves the hits of the oldest cluster to a finished cluster
+  void finish_oldest_cluster(std::vector<cluster<hit_type>> &old_clusters)
+  {
+    const uint32_t index = oldest_cluster_;
+    cluster_entry &finished = cluster_pool_[index];
+    current_toa_ = finished.first_toa;
+    old_clusters.emplace_back();
+    auto &result = old_clusters.back();
+    result.hits().reserve(finished.hit_count);
+    uint32_t hit = finished.first_hit;
+    while (hit != NONE)
+    {
+      unlink_from_pixel(hit);
+      result.add_hit(std::move(hit_pool_[hit].hit));
+      const uint32_t next_hit = hit_pool_[hit].cluster_next;
+      hit_pool_[hit].cluster_next = free_hit_;
+      free_hit_ = hit;
+      hit = next_hit;
+    }
+    release_cluster(index);
+  }
+
+public:
+  std::string name() { return "pooled_clusterer"; }
+
+  std::vector<cluster<hit_type>> &
+  get_old_clusters(std::vector<cluster<hit_type>> &old_clusters,
+                   time_type hit_toa = 0)
+  {
+    // old clusters should be at the end of the list
+    while (unfinished_clusters_count_ > 0 &&
+           (is_old(hit_toa, cluster_pool_[oldest_cluster_]) || finished_))
+      finish_oldest_cluster(old_clusters);
+    return old_clusters;
+  }
+
+  void process_hit(hit_type &&hit)
+  {
+    std::array<uint32_t, 9> neighbors;
+    uint32_t target_cluster = NONE;
+    const uint32_t neighbor_count = find_neighboring_clusters(
+        hit.coordinates(), hit.toa(), neighbors, target_cluster);
+    switch (neighbor_count)
+    {
+    case 0:
+      // pixel does not belong to any cluster, create a new one
+      target_cluster = create_cluster();
+      processed_clusters_++;
+      break;
+    case 1:
+      // target cluster is already selected by find neighboring clusters
+      break;
+    default:
+      // the hits of the other clusters are moved to the oldest one
+      ++merge_count_;
+      for (uint32_t i = 0; i < neighbor_count; ++i)
+      {
+        if (neighbors[i] != target_cluster)
+        {
+          merge_clusters(target_cluster, neighbors[i]);
+          processed_clusters_--;
+        }
+      }
+      break;
+    }
+    add_new_hit(std::move(hit), target_cluster);
+    ++processed_hit_count_;
+  }
+
+  void process_hits(hit_vect_iterator first, hit_vect_iterator last)
+  {
+    for (auto hit_it = first; hit_it != last; ++hit_it)
+    {
+      time_type current_toa = hit_it->toa();
+      process_hit(std::move(*hit_it));
+      if (processed_hit_count_ % WRITE_INTERVAL == 0)
+        get_old_clusters(result_clusters_, current_toa);
+    }
+  }
+
+  std::vector<cluster<hit_type>> process_remaining()
+  {
+    finished_ = true;
+    std::vector<cluster<hit_type>> old_clusters;
+    get_old_clusters(old_clusters);
+    std::cout << "Merge happened " << merge_count_ << " times" << std::endl;
+    std::cout << "Total hits processed " << processed_hit_count_ << std::endl;
+    std::cout << "Processed clusters " << processed_clusters_ << std::endl;
+    return old_clusters;
+  }
+
+  pooled_pixel_list_clusterer(const node_args &args)
+    : pixel_heads_(current_chip::chip_type::size_x() *
+                       current_chip::chip_type::size_y() /
+                       (args.get_arg<int>(name(), "tile_size") *
+                        args.get_arg<int>(name(), "tile_size")),
+                   NONE),
+      tile_size_(args.get_arg<int>(name(), "tile_size")),
+      result_clusters_(),
+      cluster_diff_dt(
+          hit_type::from_ns(args.get_arg<double>(name(), "max_dt")))
+  {
+    const uint64_t pool_size =
+        std::stoull(args.get_arg<std::string>(name(), "pool_size"));
+    hit_pool_.reserve(pool_size);
+    cluster_pool_.reserve(pool_size);
+  }
+
+  std::vector<cluster<hit_type>> &result_clusters()
+  {
+    return result_clusters_;
+  }
+
+  time_type current_toa() { return current_toa_; }
+
+  void close() {}
+
+  virtual ~pooled_pixel_list_clusterer() = default;
+};
@@ -1,22 +1,19 @@
 #pragma once
 #include "../data_structs/burda_hit.h"
+#include "../data_structs/node_args.h"
+#include "../other/frame_unpacker.h"
+#include "../other/mapped_file.h"
+#include "../other/prefetching_file_buffer.h"
+#include "../other/raw_file_index.h"
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <type_traits>
 #include <vector>
-enum class measurement_data_type
-{
-  KATHERINE_1_ID = 0x0,
-  KATHERINE_2_ID = 0x1,
-  PIXEL_MEASUREMENT_DATA = 0x4,
-  PIXEL_TIMESTAMP_OFFSET = 0x5,
-  CURRENT_FRAME_FINISHED = 0xC,
-  LOST_PIXEL_COUNT = 0xD
-
-};
 
 class raw_char_buffer
 {
@@ -39,11 +36,71 @@ public:
     return true;
   }
 
+  // points the block to the next (at most) byte_count bytes without copying
+  // them, returns the number of available bytes
+  uint64_t read_block(const char *&block, uint64_t byte_count)
+  {
+    if (index_offset >= size)
+      return 0;
+    block = data + index_offset;
+    byte_count = std::min(byte_count, size - index_offset);
+    index_offset += byte_count;
+    return byte_count;
+  }
+
+  void seek(uint64_t position) { index_offset = std::min(position, size); }
+
   virtual ~raw_char_buffer() = default;
 
   bool is_open() { return size > 0; }
 };
 
+// the whole input file mapped to the memory and read as raw_char_buffer,
+// the frames are decoded directly from the page cache
+class mapped_char_buffer : mapped_file, public raw_char_buffer
+{
+  // how far ahead of the decoded block the kernel should read
+  static constexpr uint64_t READ_AHEAD_SIZE = 1 << 24;
+
+public:
+  // the open mode is accepted as by std::ifstream, the file is always binary
+  mapped_char_buffer(const std::string &file_name,
+                     std::ios::openmode = std::ios::binary)
+    : mapped_file(file_name, mapped_file::access_pattern::SEQUENTIAL),
+      raw_char_buffer(mapped_file::data(), mapped_file::size())
+  {
+    prefetch(0, READ_AHEAD_SIZE);
+  }
+
+  uint64_t read_block(const char *&block, uint64_t byte_count)
+  {
+    byte_count = raw_char_buffer::read_block(block, byte_count);
+    const uint64_t block_end = block - mapped_file::data() + byte_count;
+    // request the next window once the current one is being consumed
+    if (byte_count > 0 &&
+        block_end / READ_AHEAD_SIZE !=
+            (block_end - byte_count) / READ_AHEAD_SIZE)
+      prefetch(block_end, READ_AHEAD_SIZE);
+    return byte_count;
+  }
+
+  bool is_open() { return mapped_file::is_open(); }
+};
+
+// buffers which give a direct access to the blocks of their memory
+template <typename buffer_type, typename = void>
+struct has_block_access : std::false_type
+{
+};
+
+template <typename buffer_type>
+struct has_block_access<
+    buffer_type, std::void_t<decltype(std::declval<buffer_type &>().read_block(
+                     std::declval<const char *&>(), uint64_t()))>>
+  : std::true_type
+{
+};
+
 // a node which reads the data from a stream using >> operator
 template <typename istream_type> class raw_data_reader
 {
@@ -55,13 +112,38 @@ protected:
   bool done_ = false;
   int64_t time_offset_ = 0;
   const uint32_t HIT_BYTE_SIZE = 6;
+  // number of frames decoded at once by process_hits
+  const uint32_t BLOCK_FRAME_COUNT = 1 << 14;
   bool use_io_;
+  // intermediate storage for the sources which can not be accessed directly
+  std::vector<char> block_buffer_;
+  // vectorized decoding of the blocks
+  frame_unpacker unpacker_;
+  unpacked_hits unpacked_hits_;
+  // only the hits within the window (in slow clock ticks) are passed on
+  int64_t window_start_ = 0;
+  int64_t window_end_ = std::numeric_limits<int64_t>::max();
+  // counters of the frames decoded so far
+  frame_statistics statistics_;
+
+  // obtains the next block of the input, at most byte_count bytes long
+  uint64_t next_block(const char *&block, uint64_t byte_count)
+  {
+    if constexpr (has_block_access<istream_type>::value)
+      return input_source_->read_block(block, byte_count);
+    else
+    {
+      block_buffer_.resize(byte_count);
+      input_source_->read(block_buffer_.data(), byte_count);
+      block = block_buffer_.data();
+      return input_source_->gcount();
+    }
+  }
 
 public:
-  raw_data_reader(const std::string &file_name)
-    : input_source_(std::move(
-          std::make_unique<istream_type>(file_name, std::ios::binary))),
-      use_io_(true)
+  raw_data_reader(const std::string &file_name,
+                  const node_args &args = node_args())
+    : input_source_(open_input(file_name, args)), use_io_(true)
 
   {
     check_input_stream(file_name);
@@ -72,6 +154,14 @@ public:
       io_utils::skip_bom(*istream_optional);
       io_utils::skip_comment_lines(*istream_optional);
     }
+    int64_t window_end =
+        std::stoll(args.get_arg<std::string>(name(), "window_end"));
+    if (window_end >= 0)
+      window_end_ = window_end;
+    int64_t window_start =
+        std::stoll(args.get_arg<std::string>(name(), "window_start"));
+    if (window_start > 0)
+      seek(raw_file_index::open(file_name), window_start);
   }
 
   raw_data_reader(char *hit_byte_array, uint64_t byte_array_size)
@@ -80,10 +170,64 @@ public:
   {
   }
 
+  // the read-ahead buffer is configured by the reader arguments
+  std::unique_ptr<istream_type> open_input(const std::string &file_name,
+                                           const node_args &args)
+  {
+    if constexpr (std::is_same<istream_type, prefetching_file_buffer>::value)
+    {
+      uint64_t block_size =
+          std::stoull(args.get_arg<std::string>(name(), "prefetch_block_size"));
+      auto input = std::make_unique<istream_type>(
+          file_name, std::ios::binary, block_size,
+          args.get_arg<int>(name(), "prefetch_depth"));
+      if (args.get_arg<bool>(name(), "follow"))
+        input->follow(
+            std::chrono::milliseconds(
+                args.get_arg<int>(name(), "follow_timeout")),
+            std::chrono::milliseconds(
+                args.get_arg<int>(name(), "follow_poll_interval")));
+      return input;
+    }
+    else
+      return std::make_unique<istream_type>(file_name, std::ios::binary);
+  }
+
   bool done() { return done_; }
 
   std::string name() { return "raw_reader"; }
 
+  // continues the decoding from the indexed frame preceding the hits with
+  // the ToA (in slow clock ticks), the hits before the ToA are skipped
+  void seek(const raw_file_index &index, int64_t toa)
+  {
+    const raw_file_index::entry *indexed_frame = index.find(toa);
+    uint64_t position = 0;
+    time_offset_ = 0;
+    if (indexed_frame != nullptr)
+    {
+      position = indexed_frame->byte_position;
+      time_offset_ = indexed_frame->time_offset;
+    }
+    if constexpr (std::is_base_of<raw_char_buffer, istream_type>::value)
+      input_source_->seek(position);
+    else if constexpr (std::is_base_of<std::istream, istream_type>::value)
+    {
+      input_source_->clear();
+      input_source_->seekg(position);
+    }
+    else
+      throw std::invalid_argument("The input of '" + name() +
+                                  "' does not support seeking");
+    window_start_ = toa;
+    done_ = false;
+  }
+
+  // the decoding ends once all hits up to the ToA were read
+  void set_window_end(int64_t toa) { window_end_ = toa; }
+
+  const frame_statistics &statistics() const { return statistics_; }
+
   // verify stream is opened
   void check_input_stream(const std::string &filename)
   {
@@ -109,7 +253,7 @@ public:
 
   bool parse_6byte_data_frame(uint64_t data_frame, burda_hit &hit)
   {
-
+    statistics_.count(data_frame >> 44);
     switch (static_cast<measurement_data_type>(data_frame >> 44))
     {
     case measurement_data_type::PIXEL_MEASUREMENT_DATA:
@@ -128,8 +272,7 @@ public:
       break;
     case measurement_data_type::LOST_PIXEL_COUNT:
       done_ = true;
-      std::cout << "Lost pixels in Katherine: " << (data_frame & 0x0fffffffff)
-                << std::endl;
+      statistics_.count_lost_pixels(data_frame & 0x0fffffffff);
     default:
       // std::cout << std::hex << ( data_frame >> 44) << std::endl;
       // std:: cout << "FRAME " << (data_frame >> 44) << std::endl;
@@ -138,6 +281,61 @@ public:
     return false;
   }
 
+  // decodes all complete frames of the block and appends the hits,
+  // stops after the LOST_PIXEL_COUNT frame, returns the number of bytes used
+  uint64_t decode_block(const char *block, uint64_t byte_count,
+                        std::vector<burda_hit> &hits)
+  {
+    unpacked_hits_.clear();
+    frame_unpacker::state unpack_state;
+    unpack_state.time_offset = time_offset_;
+    unpack_state.statistics = statistics_;
+    uint64_t used_bytes =
+        unpacker_.unpack(block, byte_count, unpack_state, unpacked_hits_);
+    time_offset_ = unpack_state.time_offset;
+    statistics_ = unpack_state.statistics;
+
+    hits.reserve(hits.size() + unpacked_hits_.size);
+    const uint64_t old_size = hits.size();
+    for (uint64_t i = 0; i < unpacked_hits_.size; ++i)
+    {
+      if (unpacked_hits_.toa[i] < window_start_ ||
+          unpacked_hits_.toa[i] > window_end_)
+        continue;
+      hits.emplace_back(unpacked_hits_.linear_coord[i], unpacked_hits_.toa[i],
+                        unpacked_hits_.fast_toa[i], unpacked_hits_.tot[i]);
+    }
+    processed += hits.size() - old_size;
+    // the following hits are all after the window
+    if (frame_unpacker::TOA_OFFSET_MULTIPLIER * time_offset_ > window_end_)
+      done_ = true;
+
+    // the measurement ends, no more data are going to be appended
+    if constexpr (std::is_same<istream_type, prefetching_file_buffer>::value)
+    {
+      if (unpack_state.frame_finished || unpack_state.finished)
+        input_source_->stop_following();
+    }
+    if (unpack_state.finished)
+      done_ = true;
+    return used_bytes;
+  }
+
+  // replaces the content of hits by the hits of the next block of frames
+  void process_hits(std::vector<burda_hit> &hits)
+  {
+    hits.clear();
+    const char *block = nullptr;
+    uint64_t byte_count =
+        next_block(block, uint64_t(BLOCK_FRAME_COUNT) * HIT_BYTE_SIZE);
+    if (byte_count < HIT_BYTE_SIZE)
+    {
+      done_ = true;
+      return;
+    }
+    decode_block(block, byte_count, hits);
+  }
+
   burda_hit process_hit()
   {
 
@@ -2,17 +2,21 @@
 
 #include "data_structs/cluster.h"
 
-class temporal_clusterer
+template <typename hit_type = mm_hit> class temporal_clusterer
 {
-  std::vector<cluster<mm_hit>> result_clusters_;
-  using hit_vect_iterator = std::vector<mm_hit>::iterator;
-  double current_toa = 0;
-  const double MAX_JOIN_TIME = 200.;
+  using time_type = typename hit_type::time_type;
+  std::vector<cluster<hit_type>> result_clusters_;
+  using hit_vect_iterator = typename std::vector<hit_type>::iterator;
+  time_type current_toa = 0;
+  const time_type MAX_JOIN_TIME = hit_type::from_ns(200.);
 
 public:
   temporal_clusterer() : result_clusters_(){};
 
-  std::vector<cluster<mm_hit>> &result_clusters() { return result_clusters_; }
+  std::vector<cluster<hit_type>> &result_clusters()
+  {
+    return result_clusters_;
+  }
 
   void process_hits(hit_vect_iterator first, hit_vect_iterator last)
   {
@@ -29,5 +33,8 @@ public:
     }
   }
 
-  std::vector<cluster<mm_hit>> process_remaining() { return result_clusters_; }
+  std::vector<cluster<hit_type>> process_remaining()
+  {
+    return result_clusters_;
+  }
 };
\ No newline at end of file
@@ -0,0 +1,119 @@
+#pragma once
+#include "../data_structs/node_args.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// sorts the hits temporally using a ring of time buckets, the hits are
+// appended to their bucket in O(1) and the buckets are sorted and emitted
+// once all hits which may still belong to them arrived (the disorder of the
+// datastream is bounded by the dequeue time)
+template <typename data_type> class time_wheel_sorter
+{
+  using time_type = typename data_type::time_type;
+  // maximal unorderedness of the datastream
+  const time_type dequeue_time_;
+  // number of buckets covering the dequeue time
+  static constexpr uint32_t WINDOW_BUCKET_COUNT = 256;
+  // the ring covers the window and the buckets being filled at its edges
+  static constexpr uint32_t BUCKET_COUNT = WINDOW_BUCKET_COUNT + 2;
+  const double bucket_width_;
+  std::vector<std::vector<data_type>> buckets_;
+  // absolute index of the oldest bucket which was not emitted yet
+  int64_t first_bucket_ = 0;
+  bool started_ = false;
+  std::vector<data_type> result_hits_;
+
+  int64_t bucket_index(time_type toa) const
+  {
+    return int64_t(std::floor(double(toa) / bucket_width_));
+  }
+
+  std::vector<data_type> &bucket(int64_t index)
+  {
+    // the index is negative if the data start close to zero time
+    const int64_t count = BUCKET_COUNT;
+    return buckets_[((index % count) + count) % count];
+  }
+
+  // sorts the oldest bucket, moves it to the result and advances the ring
+  void emit_first_bucket()
+  {
+    auto &first = bucket(first_bucket_);
+    std::sort(first.begin(), first.end(),
+              [](const data_type &left, const data_type &right)
+              { return left.time() < right.time(); });
+    result_hits_.insert(result_hits_.end(),
+                        std::make_move_iterator(first.begin()),
+                        std::make_move_iterator(first.end()));
+    first.clear();
+    ++first_bucket_;
+  }
+
+public:
+  std::vector<data_type> &result_hits() { return result_hits_; }
+
+  time_wheel_sorter(const node_args &args = node_args())
+    : dequeue_time_(
+          data_type::from_ns(args.get_arg<double>(name(), "dequeue_time"))),
+      bucket_width_(double(dequeue_time_) / WINDOW_BUCKET_COUNT),
+      buckets_(BUCKET_COUNT), result_hits_()
+  {
+    if (dequeue_time_ <= 0)
+      throw std::invalid_argument("The dequeue_time of '" + name() +
+                                  "' must be positive");
+  }
+
+  std::string name() { return "time_wheel_sorter"; }
+
+  void process_hit(data_type &&hit)
+  {
+    int64_t index = bucket_index(hit.time());
+    if (!started_)
+    {
+      // leave space for the hits preceding the first one
+      first_bucket_ = index - WINDOW_BUCKET_COUNT;
+      started_ = true;
+    }
+    // the buckets entirely older than the dequeue time are complete
+    const int64_t complete_end = bucket_index(hit.time() - dequeue_time_);
+    uint32_t emitted_count = 0;
+    while (first_bucket_ < complete_end ||
+           index >= first_bucket_ + BUCKET_COUNT)
+    {
+      if (emitted_count == BUCKET_COUNT)
+      {
+        // the ring is empty, so a gap in time is skipped at once
+        first_bucket_ = std::max(complete_end, index - BUCKET_COUNT + 1);
+        break;
+      }
+      emit_first_bucket();
+      ++emitted_count;
+    }
+    // the hits delayed more than the dequeue time are emitted as soon as
+    // possible
+    index = std::max(index, first_bucket_);
+    bucket(index).emplace_back(std::move(hit));
+  }
+
+  // processes a block of hits, the content of the block is moved
+  void process_hits(std::vector<data_type> &hits)
+  {
+    for (auto &hit : hits)
+      process_hit(std::move(hit));
+    hits.clear();
+  }
+
+  std::vector<data_type> process_remaining()
+  {
+    // remove the remaining hits at the end of datastream
+    for (uint32_t i = 0; i < BUCKET_COUNT; ++i)
+      emit_first_bucket();
+    return result_hits_;
+  }
+
+  virtual ~time_wheel_sorter() = default;
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include "frame_unpacker.h"
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ip/icmp.hpp>
@@ -23,17 +24,6 @@ enum class command_type
   GET_SENSOR_TEMP = 0x19
 };
 
-enum class measurement_data_type
-{
-  KATHERINE_1_ID = 0x0,
-  KATHERINE_2_ID = 0x1,
-  PIXEL_MEASUREMENT_DATA = 0x4,
-  PIXEL_TIMESTAMP_OFFSET = 0x5,
-  CURRENT_FRAME_FINISHED = 0xC,
-  LOST_PIXEL_COUNT = 0xD
-
-};
-
 class katherine_parser
 {
   const uint16_t FRAME_TYPE_OFFSET = 44;
@@ -41,12 +31,16 @@ class katherine_parser
   const uint16_t TOA_OFFSET = 14;
   const uint16_t TOT_OFFSET = 4;
   uint32_t time_offset_ = 0;
+  // counters of the frames received so far
+  frame_statistics statistics_;
 
 public:
   uint64_t total_hits_received = 0;
 
   uint32_t time_offset() { return time_offset_; }
 
+  const frame_statistics &statistics() const { return statistics_; }
+
   std::string parse_chip_id(char *response)
   {
     std::cout << "Chip iD ";
@@ -84,7 +78,7 @@ public:
 
   bool parse_6byte_data_frame(int64_t data_frame, std::vector<burda_hit> &hits)
   {
-
+    statistics_.count(data_frame >> 44);
     switch (static_cast<measurement_data_type>(data_frame >> 44))
     {
     case measurement_data_type::PIXEL_MEASUREMENT_DATA:
@@ -98,12 +92,10 @@ public:
       break;
     case measurement_data_type::CURRENT_FRAME_FINISHED:
       total_hits_received = (data_frame & 0x0fffffffff);
-      std::cout << "TOTAL HITS RECEIVED: " << total_hits_received << std::endl;
       return true;
       break;
     case measurement_data_type::LOST_PIXEL_COUNT:
-      std::cout << "Lost pixels in Katherine: " << (data_frame & 0x0fffffffff)
-                << std::endl;
+      statistics_.count_lost_pixels(data_frame & 0x0fffffffff);
       return true;
     default:
       // std::cout << std::hex << ( data_frame >> 44) << std::endl;
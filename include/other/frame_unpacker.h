@@ -0,0 +1,129 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class measurement_data_type
+{
+  KATHERINE_1_ID = 0x0,
+  KATHERINE_2_ID = 0x1,
+  PIXEL_MEASUREMENT_DATA = 0x4,
+  PIXEL_TIMESTAMP_OFFSET = 0x5,
+  CURRENT_FRAME_FINISHED = 0xC,
+  LOST_PIXEL_COUNT = 0xD
+
+};
+
+// counters of the decoded frames, cheap enough to be kept in the hot loop,
+// the counters are written by a single thread but they can be read by other
+// threads during the run
+struct frame_statistics
+{
+  static constexpr uint32_t FRAME_TYPE_COUNT = 16;
+  // number of the frames of each type, indexed by the 4 bit frame type
+  std::array<std::atomic<uint64_t>, FRAME_TYPE_COUNT> frame_counts{};
+  // sum of the LOST_PIXEL_COUNT frames
+  std::atomic<uint64_t> lost_pixel_count{0};
+
+  frame_statistics() = default;
+  frame_statistics(const frame_statistics &other) { *this = other; }
+  frame_statistics &operator=(const frame_statistics &other);
+
+  // the single writer does not need an atomic read-modify-write
+  static void add(std::atomic<uint64_t> &counter, uint64_t value)
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+  }
+  void count(uint32_t frame_type, uint64_t frame_count = 1)
+  {
+    add(frame_counts[frame_type], frame_count);
+  }
+  void count_lost_pixels(uint64_t pixel_count)
+  {
+    add(lost_pixel_count, pixel_count);
+  }
+  uint64_t frame_count(measurement_data_type type) const
+  {
+    return frame_counts[static_cast<uint32_t>(type)].load(
+        std::memory_order_relaxed);
+  }
+  uint64_t total_frame_count() const;
+  uint64_t pixel_frame_count() const;
+  uint64_t offset_update_count() const;
+  // frames of the types not listed in measurement_data_type
+  uint64_t unknown_frame_count() const;
+};
+
+std::ostream &operator<<(std::ostream &os, const frame_statistics &statistics);
+
+// hits unpacked from the 6 byte frames, stored as a structure of arrays
+struct unpacked_hits
+{
+  std::vector<uint16_t> linear_coord;
+  // number of ticks of the slow clock, including the time offset
+  std::vector<int64_t> toa;
+  std::vector<uint8_t> fast_toa;
+  std::vector<int16_t> tot;
+  // number of valid entries, the arrays are only grown
+  uint64_t size = 0;
+
+  void reserve(uint64_t capacity)
+  {
+    if (toa.size() >= capacity)
+      return;
+    linear_coord.resize(capacity);
+    toa.resize(capacity);
+    fast_toa.resize(capacity);
+    tot.resize(capacity);
+  }
+
+  void clear() { size = 0; }
+};
+
+// splits the raw Katherine frames to the hit fields, the fastest kernel
+// supported by the CPU is selected at runtime
+class frame_unpacker
+{
+public:
+  // decoding state carried across the blocks
+  struct state
+  {
+    int64_t time_offset = 0;
+    // set after the CURRENT_FRAME_FINISHED frame
+    bool frame_finished = false;
+    // set after the LOST_PIXEL_COUNT frame, which ends the measurement
+    bool finished = false;
+    frame_statistics statistics;
+  };
+
+  // unpacks the complete frames of the block and appends the pixel hits,
+  // returns the number of bytes used
+  using kernel_type = uint64_t (*)(const char *block, uint64_t byte_count,
+                                   state &unpack_state, unpacked_hits &hits);
+
+  static constexpr uint32_t FRAME_BYTE_SIZE = 6;
+  // ToA ticks per unit of the time offset
+  static constexpr int64_t TOA_OFFSET_MULTIPLIER = 4096;
+  // number of ToA ticks representable by a pixel frame
+  static constexpr int64_t FRAME_TOA_RANGE = 1 << 14;
+
+  static uint64_t unpack_scalar(const char *block, uint64_t byte_count,
+                                state &unpack_state, unpacked_hits &hits);
+  static uint64_t unpack_sse4(const char *block, uint64_t byte_count,
+                              state &unpack_state, unpacked_hits &hits);
+  static uint64_t unpack_avx2(const char *block, uint64_t byte_count,
+                              state &unpack_state, unpacked_hits &hits);
+
+  frame_unpacker();
+  uint64_t unpack(const char *block, uint64_t byte_count, state &unpack_state,
+                  unpacked_hits &hits) const;
+  std::string kernel_name() const;
+
+private:
+  kernel_type kernel_;
+  std::string kernel_name_;
+};
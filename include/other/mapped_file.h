@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// read-only memory mapping of a whole file, the pages are read directly
+// from the page cache, without any copy to the user space
+class mapped_file
+{
+  char *data_ = nullptr;
+  uint64_t size_ = 0;
+  bool is_open_ = false;
+
+  void unmap();
+
+public:
+  // how the mapping is going to be accessed, used as a hint for the kernel
+  enum class access_pattern
+  {
+    SEQUENTIAL,
+    RANDOM
+  };
+
+  mapped_file(const std::string &file_name,
+              access_pattern pattern = access_pattern::SEQUENTIAL);
+  mapped_file(const mapped_file &) = delete;
+  mapped_file &operator=(const mapped_file &) = delete;
+  mapped_file(mapped_file &&other);
+  mapped_file &operator=(mapped_file &&other);
+  virtual ~mapped_file();
+
+  // hint the kernel to start reading the given range ahead
+  void prefetch(uint64_t offset, uint64_t byte_count) const;
+  char *data() const;
+  uint64_t size() const;
+  bool is_open() const;
+};
@@ -86,7 +86,10 @@ public:
   template <typename cluster_type>
   mm_write_stream &operator<<(const cluster_type &cluster)
   {
-    *cl_buffer_ << double_to_str(cluster.first_toa()) << " ";
+    // the time of the cluster is written in ns regardless of the hit type
+    *cl_buffer_ << double_to_str(
+                       cluster_type::hit_type::to_ns(cluster.first_toa()))
+                << " ";
     *cl_buffer_ << cluster.hit_count() << " " << current_line << " "
                 << current_byte << "\n";
     ++clusters_written_;
@@ -205,8 +208,9 @@ public:
     *cl_file_ >> hit_count >> line_start >> byte_start;
     // cl.set_byte_start(byte_start);
     // cl.set_line_start(line_start);
-    cl.set_last_toa(ftoa); // is updated in .add_hit automatically
-    cl.set_first_toa(ftoa);
+    // is updated in .add_hit automatically
+    cl.set_last_toa(hit_type::from_ns(ftoa));
+    cl.set_first_toa(hit_type::from_ns(ftoa));
     cl.hits().reserve(hit_count);
     short x, y;
     double toa = 0, tot = 0, e = 0;
@@ -221,7 +225,7 @@ public:
       else
       {
         *px_file_ >> x >> y >> toa >> tot;
-        cl.add_hit(hit_type{x, y, toa, tot});
+        cl.add_hit(hit_type{x, y, hit_type::from_ns(toa), tot});
       }
     }
     char hash_char;
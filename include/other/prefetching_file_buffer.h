@@ -0,0 +1,82 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <ios>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// binary file read ahead by a dedicated I/O thread into a ring of blocks,
+// the consumer accesses the blocks directly without copying them,
+// gzip (.gz) and zstd (.zst) files are decompressed by the I/O thread
+class prefetching_file_buffer
+{
+  struct block
+  {
+    std::vector<char> data;
+    uint64_t size = 0;
+  };
+
+  std::vector<block> ring_;
+  uint64_t block_size_;
+  // blocks read by the I/O thread and not yet released by the consumer
+  uint32_t filled_count_ = 0;
+  // next block to be filled by the I/O thread
+  uint32_t fill_index_ = 0;
+  // block being consumed and the position in it
+  uint32_t consume_index_ = 0;
+  uint64_t consume_offset_ = 0;
+  bool holding_block_ = false;
+  bool read_failed_ = false;
+  bool stop_ = false;
+  // wait for the data appended to the file instead of ending at its end
+  bool following_ = false;
+  std::chrono::milliseconds follow_timeout_{0};
+  std::chrono::milliseconds poll_interval_{0};
+  int file_descriptor_ = -1;
+  // reads at most byte_count bytes at the offset, returns -1 on failure
+  std::function<int64_t(char *, uint64_t, uint64_t)> read_function_;
+  // compressed streams can not be read from an arbitrary offset
+  bool seekable_ = true;
+  std::mutex mutex_;
+  std::condition_variable block_filled_;
+  std::condition_variable block_released_;
+  std::thread io_thread_;
+
+  void open_file(const std::string &file_name);
+  void open_compressed(const std::string &file_name);
+  void read_ahead();
+  void release_block();
+  bool is_following();
+  bool wait_for_data(std::chrono::steady_clock::time_point last_data_time);
+
+public:
+  static constexpr uint64_t DEFAULT_BLOCK_SIZE = 1 << 22;
+  static constexpr uint32_t DEFAULT_DEPTH = 4;
+  // the blocks contain only whole 6 byte frames
+  static constexpr uint32_t FRAME_BYTE_SIZE = 6;
+
+  prefetching_file_buffer(const std::string &file_name,
+                          std::ios::openmode mode = std::ios::binary,
+                          uint64_t block_size = DEFAULT_BLOCK_SIZE,
+                          uint32_t depth = DEFAULT_DEPTH);
+  prefetching_file_buffer(const prefetching_file_buffer &) = delete;
+  prefetching_file_buffer &operator=(const prefetching_file_buffer &) = delete;
+  virtual ~prefetching_file_buffer();
+
+  static bool is_compressed(const std::string &file_name);
+  // keep reading the data appended to the file until no data arrive
+  // for the timeout period, must be called before the first read
+  void follow(std::chrono::milliseconds timeout,
+              std::chrono::milliseconds poll_interval);
+  // the end of the measurement was seen, the end of the file is final
+  void stop_following();
+  // points the block to the next (at most) byte_count bytes, the pointer is
+  // valid until the next call, returns the number of available bytes
+  uint64_t read_block(const char *&block, uint64_t byte_count);
+  bool read(char *read_bytes, uint32_t byte_count);
+  bool is_open();
+};
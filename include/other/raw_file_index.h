@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// sparse index of the PIXEL_TIMESTAMP_OFFSET frames of a raw file,
+// the decoding can be started at any indexed frame with the correct state,
+// so the file can be processed from a chosen time or split to shards
+class raw_file_index
+{
+public:
+  struct entry
+  {
+    // position of the PIXEL_TIMESTAMP_OFFSET frame in the file
+    uint64_t byte_position;
+    // time offset set by the frame
+    int64_t time_offset;
+  };
+
+  // distance of the indexed frames in bytes
+  static constexpr uint64_t DEFAULT_STRIDE = 1 << 20;
+
+  raw_file_index() = default;
+
+  // scans the raw file, the first offset frame after every stride is indexed
+  static raw_file_index build(const std::string &raw_file_name,
+                              uint64_t stride = DEFAULT_STRIDE);
+  static raw_file_index load(const std::string &index_file_name);
+  // loads the sidecar index of the raw file, it is built and saved
+  // if it does not exist or it was built from a different content
+  static raw_file_index open(const std::string &raw_file_name);
+  static std::string sidecar_name(const std::string &raw_file_name);
+
+  void save(const std::string &index_file_name) const;
+  // the last entry before all hits with the ToA (in slow clock ticks) at
+  // least toa, null if the decoding has to start from the beginning,
+  // the time offsets are expected to be non-decreasing
+  const entry *find(int64_t toa) const;
+  const std::vector<entry> &entries() const;
+
+private:
+  // identifies the content of the raw file by its size and the checksum of
+  // its first and last bytes, as the modification time can be preserved by
+  // the copies and a followed file keeps growing
+  struct source_state
+  {
+    uint64_t size = 0;
+    uint64_t checksum = 0;
+  };
+  // number of the bytes checksummed at each end of the raw file
+  static constexpr uint64_t CHECKSUM_BYTE_COUNT = 1 << 16;
+
+  std::vector<entry> entries_;
+  source_state source_;
+
+  static source_state read_source_state(const char *data, uint64_t size);
+};
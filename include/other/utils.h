@@ -52,6 +52,12 @@ struct coord
   int32_t linearize_tiled(
       uint32_t tile_size) const; // use if tiled coord -> tiled linear
 
+  int32_t linearize_morton(
+      uint32_t tile_size) const; // use if untiled coord -> tiled Z-order
+
+  // number of the Z-order indices of the tiled coords
+  static uint32_t morton_size(uint32_t tile_size);
+
   bool is_valid_neighbor(const coord &neighbor, int32_t tile_size = 1) const;
 
   coord operator+(const coord &right);
@@ -1,5 +1,6 @@
 
 #include "data_structs/burda_hit.h"
+#include <cmath>
 
 burda_hit::burda_hit(uint16_t linear_coord, int64_t toa, short fast_toa,
                      int16_t tot)
@@ -39,17 +40,26 @@ uint16_t burda_hit::linear_coord() const { return linear_coord_; }
 
 uint64_t burda_hit::tick_toa() const { return toa_; }
 
+int64_t burda_hit::fast_tick_toa() const
+{
+  const int64_t fast_ticks_per_tick = slow_clock_dt / fast_clock_dt;
+  return fast_ticks_per_tick * toa_ - fast_toa_;
+}
+
 double burda_hit::toa() const
 {
   return slow_clock_dt * toa_ - fast_clock_dt * fast_toa_;
 }
 
-double burda_hit::time() const
+burda_hit::time_type burda_hit::time() const { return fast_tick_toa(); }
+
+burda_hit::time_type burda_hit::from_ns(double ns)
 {
-  return slow_clock_dt * toa_ - fast_clock_dt * fast_toa_;
-  ;
+  return std::llround(ns / fast_clock_dt);
 }
 
+double burda_hit::to_ns(time_type time) { return time * fast_clock_dt; }
+
 void burda_hit::update_time(uint64_t new_toa, short fast_toa)
 {
   toa_ = new_toa;
@@ -1,9 +1,36 @@
 #include "data_structs/calibration.h"
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CALIBRATION_X86
+#endif
 
 // object which is capable of converting ToT in ticks to deposited enegy in keV
 
+namespace
+{
+const double epsilon = 0.000000000001;
+const double invalid_value = 0.1;
+const char binary_magic[8] = {'C', 'L', 'C', 'A', 'L', 'I', 'B', '\0'};
+
+// the greater root of the quadratic formula, clamped to the invalid value
+inline double pixel_energy(const calibration::pixel_constants &pixel,
+                           double tot)
+{
+  double a2 = pixel.a;
+  double b2 = (-pixel.a * pixel.t + pixel.b - tot);
+  double c2 = tot * pixel.t - pixel.b * pixel.t - pixel.c;
+  if (std::abs(a2) < epsilon || b2 * b2 - 4 * a2 * c2 < 0)
+    return invalid_value;
+  return std::max((-b2 + std::sqrt(b2 * b2 - 4 * a2 * c2)) / (2 * a2),
+                  invalid_value); // greater root of quad formula
+}
+} // namespace
+
 void calibration::load_calib_vector(std::string &&name, const coord &chip_size,
-                                    std::vector<std::vector<double>> &vector)
+                                    calib_type matrix_name)
 {
   std::ifstream calib_stream(name);
   if (!calib_stream.is_open())
@@ -11,18 +38,12 @@ void calibration::load_calib_vector(std::string &&name, const coord &chip_size,
     throw std::invalid_argument("The file '" + name +
                                 "' can not be used for calibration");
   }
-  vector.reserve(chip_size.x());
-  for (uint32_t i = 0; i < chip_size.x(); i++)
+  resize(chip_size.x(), chip_size.y());
+  for (auto &pixel : constants_)
   {
-    std::vector<double> line;
-    line.reserve(chip_size.y());
-    for (uint32_t j = 0; j < chip_size.y(); j++)
-    {
-      double x;
-      calib_stream >> x;
-      line.push_back(x);
-    }
-    vector.emplace_back(std::move(line));
+    double x;
+    calib_stream >> x;
+    constant(pixel, matrix_name) = x;
   }
 }
 
@@ -43,6 +64,157 @@ std::string calibration::add_last_folder_separator(const std::string &path)
   }
 }
 
+void calibration::resize(uint32_t row_count, uint32_t row_length)
+{
+  // the mapped constants are read-only, they are copied before a change
+  if (mapping_)
+  {
+    constants_.assign(constants(), constants() + uint64_t(row_count_) *
+                                                     row_length_);
+    mapping_.reset();
+  }
+  if (row_count == row_count_ && row_length == row_length_)
+    return;
+  row_count_ = row_count;
+  row_length_ = row_length;
+  constants_.assign(uint64_t(row_count) * row_length, pixel_constants{});
+}
+
+double &calibration::constant(pixel_constants &pixel, calib_type matrix_name)
+{
+  switch (matrix_name)
+  {
+  case calibration::calib_type::A:
+    return pixel.a;
+  case calibration::calib_type::B:
+    return pixel.b;
+  case calibration::calib_type::C:
+    return pixel.c;
+  default:
+    return pixel.t;
+  }
+}
+
+void calibration::select_batch_kernel()
+{
+  batch_kernel_ = compute_energy_scalar;
+#ifdef CALIBRATION_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx"))
+    batch_kernel_ = compute_energy_avx;
+#endif
+}
+
+const calibration::pixel_constants *calibration::constants() const
+{
+  if (mapping_)
+    return reinterpret_cast<const pixel_constants *>(mapping_->data() +
+                                                     sizeof(binary_header));
+  return constants_.data();
+}
+
+uint64_t calibration::checksum(const char *bytes, uint64_t size,
+                               uint64_t hash)
+{
+  // FNV-1a over the 64 bit words, the remaining bytes are hashed one by one
+  const uint64_t word_count = size / sizeof(hash);
+  for (uint64_t i = 0; i < word_count; ++i)
+  {
+    uint64_t word;
+    std::memcpy(&word, bytes + i * sizeof(word), sizeof(word));
+    hash = (hash ^ word) * 0x100000001b3ULL;
+  }
+  for (uint64_t i = word_count * sizeof(hash); i < size; ++i)
+    hash = (hash ^ uint8_t(bytes[i])) * 0x100000001b3ULL;
+  return hash;
+}
+
+// the modification times are not reliable (the files can be copied with
+// their times preserved), so the cache is bound to the content of the files
+bool calibration::read_source_state(const std::string &calib_folder,
+                                    source_state &source)
+{
+  source = source_state{};
+  source.checksum = checksum(nullptr, 0);
+  uint32_t i = 0;
+  for (auto suffix : {a_suffix, b_suffix, c_suffix, t_suffix})
+  {
+    mapped_file text(calib_folder + std::string(suffix));
+    if (!text.is_open())
+      return false;
+    source.sizes[i++] = text.size();
+    source.checksum = checksum(text.data(), text.size(), source.checksum);
+  }
+  return true;
+}
+
+// maps the binary cache, returns false if it is not valid for the chip
+bool calibration::load_binary(const std::string &binary_name,
+                              const coord &chip_size,
+                              const source_state &source)
+{
+  auto mapping = std::make_shared<mapped_file>(
+      binary_name, mapped_file::access_pattern::RANDOM);
+  if (!mapping->is_open() || mapping->size() < sizeof(binary_header))
+    return false;
+  binary_header header;
+  std::memcpy(&header, mapping->data(), sizeof(header));
+  const uint64_t pixel_count = uint64_t(chip_size.x()) * chip_size.y();
+  if (std::memcmp(header.magic, binary_magic, sizeof(binary_magic)) != 0 ||
+      header.version != binary_version ||
+      header.row_count != uint32_t(chip_size.x()) ||
+      header.row_length != uint32_t(chip_size.y()) ||
+      mapping->size() !=
+          sizeof(header) + pixel_count * sizeof(pixel_constants) ||
+      std::memcmp(&header.source, &source, sizeof(source)) != 0)
+    return false;
+  if (checksum(mapping->data() + sizeof(header),
+               pixel_count * sizeof(pixel_constants)) != header.checksum)
+    return false;
+  constants_.clear();
+  mapping_ = std::move(mapping);
+  row_count_ = header.row_count;
+  row_length_ = header.row_length;
+  return true;
+}
+
+// the cache is written to a temporary file first, so the processes which
+// load the calibration concurrently never see an incomplete cache
+void calibration::save_binary(const std::string &binary_name,
+                              const source_state &source) const
+{
+  binary_header header{};
+  std::memcpy(header.magic, binary_magic, sizeof(binary_magic));
+  header.version = binary_version;
+  header.row_count = row_count_;
+  header.row_length = row_length_;
+  const uint64_t pixel_count = uint64_t(row_count_) * row_length_;
+  header.checksum =
+      checksum(reinterpret_cast<const char *>(constants()),
+               pixel_count * sizeof(pixel_constants));
+  header.source = source;
+
+  const std::string temporary_name =
+      binary_name + "." + std::to_string(::getpid()) + ".tmp";
+  {
+    std::ofstream binary_stream(temporary_name, std::ios::binary);
+    if (!binary_stream.is_open())
+      return;
+    binary_stream.write(reinterpret_cast<const char *>(&header),
+                        sizeof(header));
+    binary_stream.write(reinterpret_cast<const char *>(constants()),
+                        pixel_count * sizeof(pixel_constants));
+    if (!binary_stream)
+    {
+      binary_stream.close();
+      std::remove(temporary_name.c_str());
+      return;
+    }
+  }
+  if (std::rename(temporary_name.c_str(), binary_name.c_str()) != 0)
+    std::remove(temporary_name.c_str());
+}
+
 calibration::calibration(const std::string &calib_folder,
                          const coord &chip_size)
 {
@@ -50,55 +222,140 @@ calibration::calibration(const std::string &calib_folder,
   formatted_folder = has_last_folder_separator(calib_folder)
                          ? calib_folder
                          : add_last_folder_separator(calib_folder);
-  load_calib_vector(formatted_folder + std::string(a_suffix), chip_size, a_);
-  load_calib_vector(formatted_folder + std::string(b_suffix), chip_size, b_);
-  load_calib_vector(formatted_folder + std::string(c_suffix), chip_size, c_);
-  load_calib_vector(formatted_folder + std::string(t_suffix), chip_size, t_);
+  // the text files are parsed only once, later the binary cache is mapped
+  const std::string binary_name =
+      formatted_folder + std::string(binary_suffix);
+  source_state source;
+  const bool has_source = read_source_state(formatted_folder, source);
+  if (has_source && load_binary(binary_name, chip_size, source))
+  {
+    select_batch_kernel();
+    return;
+  }
+  load_calib_vector(formatted_folder + std::string(a_suffix), chip_size,
+                    calib_type::A);
+  load_calib_vector(formatted_folder + std::string(b_suffix), chip_size,
+                    calib_type::B);
+  load_calib_vector(formatted_folder + std::string(c_suffix), chip_size,
+                    calib_type::C);
+  load_calib_vector(formatted_folder + std::string(t_suffix), chip_size,
+                    calib_type::T);
+  // the folder can be read-only, the cache is optional
+  save_binary(binary_name, source);
+  select_batch_kernel();
 }
 
 calibration::calibration(const std::vector<std::vector<double>> &a,
                          const std::vector<std::vector<double>> &b,
                          const std::vector<std::vector<double>> &c,
                          const std::vector<std::vector<double>> &t)
-  : a_(a), b_(b), c_(c), t_(t)
 {
+  set_calib(a, calib_type::A);
+  set_calib(b, calib_type::B);
+  set_calib(c, calib_type::C);
+  set_calib(t, calib_type::T);
+  select_batch_kernel();
 }
 
 void calibration::set_calib(
     const std::vector<std::vector<double>> &calib_matrix,
     calibration::calib_type matrix_name)
 {
-  switch (matrix_name)
-  {
-  case calibration::calib_type::A:
-    a_ = calib_matrix;
-    break;
-  case calibration::calib_type::B:
-    b_ = calib_matrix;
-    break;
-  case calibration::calib_type::C:
-    c_ = calib_matrix;
-    break;
-  case calibration::calib_type::T:
-    t_ = calib_matrix;
-    break;
-  }
+  resize(calib_matrix.size(),
+         calib_matrix.empty() ? 0 : calib_matrix[0].size());
+  for (uint32_t y = 0; y < row_count_; ++y)
+    for (uint32_t x = 0; x < row_length_; ++x)
+      constant(constants_[uint64_t(y) * row_length_ + x], matrix_name) =
+          calib_matrix[y][x];
 }
 
 // does the conversion from ToT to E[keV]
 double calibration::compute_energy(short x, short y, double tot)
 {
-  double a = a_[y][x];
-  double c = c_[y][x];
-  double t = t_[y][x];
-  double b = b_[y][x];
-  const double epsilon = 0.000000000001;
-  double a2 = a;
-  double b2 = (-a * t + b - tot);
-  double c2 = tot * t - b * t - c;
-  const double invalid_value = 0.1;
-  if (std::abs(a2) < epsilon || b2 * b2 - 4 * a2 * c2 < 0)
-    return invalid_value;
-  return std::max((-b2 + std::sqrt(b2 * b2 - 4 * a2 * c2)) / (2 * a2),
-                  invalid_value); // greater root of quad formula
+  return pixel_energy(constants()[uint64_t(y) * row_length_ + x], tot);
+}
+
+void calibration::compute_energy(const uint32_t *pixels, const double *tots,
+                                 double *energies, uint64_t count) const
+{
+  batch_kernel_(constants(), pixels, tots, energies, count);
+}
+
+void calibration::compute_energy_scalar(const pixel_constants *constants,
+                                        const uint32_t *pixels,
+                                        const double *tots, double *energies,
+                                        uint64_t count)
+{
+  for (uint64_t i = 0; i < count; ++i)
+    energies[i] = pixel_energy(constants[pixels[i]], tots[i]);
+}
+
+#ifdef CALIBRATION_X86
+
+// four hits per iteration, the constants of the pixels are transposed
+// to the vectors of a, b, c and t, the invalid energies are masked out,
+// the operations keep the order of the scalar version to give equal results
+__attribute__((target("avx"))) void
+calibration::compute_energy_avx(const pixel_constants *constants,
+                                const uint32_t *pixels, const double *tots,
+                                double *energies, uint64_t count)
+{
+  const uint32_t hits_per_step = 4;
+  const __m256d sign_mask = _mm256_set1_pd(-0.0);
+  const __m256d epsilon_vector = _mm256_set1_pd(epsilon);
+  const __m256d invalid_vector = _mm256_set1_pd(invalid_value);
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d two = _mm256_set1_pd(2);
+  const __m256d four = _mm256_set1_pd(4);
+  uint64_t i = 0;
+  for (; i + hits_per_step <= count; i += hits_per_step)
+  {
+    const __m256d pixel_0 = _mm256_load_pd(&constants[pixels[i]].a);
+    const __m256d pixel_1 = _mm256_load_pd(&constants[pixels[i + 1]].a);
+    const __m256d pixel_2 = _mm256_load_pd(&constants[pixels[i + 2]].a);
+    const __m256d pixel_3 = _mm256_load_pd(&constants[pixels[i + 3]].a);
+    // a0 a1 c0 c1, b0 b1 t0 t1, a2 a3 c2 c3, b2 b3 t2 t3
+    const __m256d low_01 = _mm256_unpacklo_pd(pixel_0, pixel_1);
+    const __m256d high_01 = _mm256_unpackhi_pd(pixel_0, pixel_1);
+    const __m256d low_23 = _mm256_unpacklo_pd(pixel_2, pixel_3);
+    const __m256d high_23 = _mm256_unpackhi_pd(pixel_2, pixel_3);
+    const __m256d a = _mm256_permute2f128_pd(low_01, low_23, 0x20);
+    const __m256d c = _mm256_permute2f128_pd(low_01, low_23, 0x31);
+    const __m256d b = _mm256_permute2f128_pd(high_01, high_23, 0x20);
+    const __m256d t = _mm256_permute2f128_pd(high_01, high_23, 0x31);
+    const __m256d tot = _mm256_loadu_pd(tots + i);
+
+    const __m256d b2 = _mm256_sub_pd(
+        _mm256_add_pd(_mm256_mul_pd(_mm256_xor_pd(a, sign_mask), t), b), tot);
+    const __m256d c2 = _mm256_sub_pd(
+        _mm256_sub_pd(_mm256_mul_pd(tot, t), _mm256_mul_pd(b, t)), c);
+    const __m256d discriminant = _mm256_sub_pd(
+        _mm256_mul_pd(b2, b2), _mm256_mul_pd(_mm256_mul_pd(four, a), c2));
+    const __m256d is_invalid = _mm256_or_pd(
+        _mm256_cmp_pd(_mm256_andnot_pd(sign_mask, a), epsilon_vector,
+                      _CMP_LT_OQ),
+        _mm256_cmp_pd(discriminant, zero, _CMP_LT_OQ));
+    const __m256d root = _mm256_div_pd(
+        _mm256_add_pd(_mm256_xor_pd(b2, sign_mask),
+                      _mm256_sqrt_pd(discriminant)),
+        _mm256_mul_pd(two, a));
+    // the second operand is returned for NaN, the same as by std::max
+    const __m256d energy = _mm256_max_pd(invalid_vector, root);
+    _mm256_storeu_pd(energies + i,
+                     _mm256_blendv_pd(energy, invalid_vector, is_invalid));
+  }
+  compute_energy_scalar(constants, pixels + i, tots + i, energies + i,
+                        count - i);
 }
+
+#else
+
+void calibration::compute_energy_avx(const pixel_constants *constants,
+                                     const uint32_t *pixels,
+                                     const double *tots, double *energies,
+                                     uint64_t count)
+{
+  compute_energy_scalar(constants, pixels, tots, energies, count);
+}
+
+#endif
@@ -0,0 +1,42 @@
+#include "data_structs/compact_hit.h"
+#include "data_structs/tick_hit.h"
+#include <cmath>
+
+// a 16 byte variant of tick_hit for the memory bound runs, the coordinates
+// are stored in 8 bits (the chip has 256x256 pixels) and the energy
+// in single precision
+
+compact_hit::compact_hit(short x, short y, int64_t toa, double e)
+  : toa_(toa), e_(e), x_(x), y_(y)
+{
+}
+
+compact_hit::compact_hit() {}
+
+compact_hit::time_type compact_hit::from_ns(double ns)
+{
+  return tick_hit::from_ns(ns);
+}
+
+double compact_hit::to_ns(time_type time) { return tick_hit::to_ns(time); }
+
+coord compact_hit::coordinates() const { return coord(x_, y_); }
+
+short compact_hit::x() const { return x_; }
+
+short compact_hit::y() const { return y_; }
+
+int64_t compact_hit::time() const { return toa(); }
+
+int64_t compact_hit::toa() const { return toa_; }
+
+double compact_hit::toa_ns() const { return to_ns(toa_); }
+
+double compact_hit::e() const { return e_; }
+
+bool compact_hit::approx_equals(const compact_hit &other)
+{
+  const double epsilon = 0.01;
+  return (x() == other.x() && y() == other.y() && toa() == other.toa() &&
+          std::abs(e() - other.e()) < epsilon);
+}
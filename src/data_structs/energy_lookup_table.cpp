@@ -0,0 +1,81 @@
+#include "data_structs/energy_lookup_table.h"
+#include <algorithm>
+#include <stdexcept>
+
+// energies precomputed for each (pixel, ToT) pair, so the conversion of most
+// hits is a single load from the table, the rows of the pixels are populated
+// lazily and only as many pixels as the memory budget allows are tabulated
+
+energy_lookup_table::energy_lookup_table(calibration &calib,
+                                         const coord &chip_size,
+                                         precision table_precision,
+                                         uint64_t memory_budget)
+  : calib_(calib), precision_(table_precision), row_length_(chip_size.y()),
+    pixel_slots_(uint32_t(chip_size.x()) * chip_size.y(), NO_SLOT)
+{
+  const uint64_t row_byte_size =
+      TOT_VALUE_COUNT *
+      (table_precision == precision::FLOAT ? sizeof(float) : sizeof(uint16_t));
+  max_slot_count_ = std::min<uint64_t>(memory_budget / row_byte_size,
+                                       pixel_slots_.size());
+  // the capacity is only reserved, the rows are zeroed once they are used
+  const uint64_t max_entry_count = uint64_t(max_slot_count_) * TOT_VALUE_COUNT;
+  if (table_precision == precision::FLOAT)
+    float_energies_.reserve(max_entry_count);
+  else
+    half_energies_.reserve(max_entry_count);
+}
+
+energy_lookup_table::precision
+energy_lookup_table::parse_precision(const std::string &name)
+{
+  if (name == "float")
+    return precision::FLOAT;
+  if (name == "half")
+    return precision::HALF;
+  throw std::invalid_argument("Unknown energy lookup table precision '" +
+                              name + "', expected float or half");
+}
+
+uint32_t energy_lookup_table::assign_slot(uint32_t pixel)
+{
+  if (used_slot_count_ == max_slot_count_)
+    return NO_SLOT;
+  const uint64_t table_size = uint64_t(used_slot_count_ + 1) * TOT_VALUE_COUNT;
+  if (precision_ == precision::FLOAT)
+    float_energies_.resize(table_size, 0);
+  else
+    half_energies_.resize(table_size, 0);
+  pixel_slots_[pixel] = used_slot_count_;
+  return used_slot_count_++;
+}
+
+// rounds to the nearest half precision value, the values out of the range
+// of the normal numbers are clamped
+uint16_t energy_lookup_table::float_to_half(float value)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const uint16_t sign = (bits >> 16) & 0x8000U;
+  const int32_t exponent = int32_t((bits >> 23) & 0xffU) - 127 + 15;
+  const uint16_t max_normal = 0x7bffU;
+  const uint16_t min_normal = 0x0400U;
+  if (exponent >= 0x1f)
+    return sign | max_normal;
+  if (exponent <= 0)
+    return sign | min_normal;
+  const uint32_t mantissa = bits & 0x7fffffU;
+  uint16_t half = sign | (exponent << 10) | (mantissa >> 13);
+  // round half to even, the carry may propagate to the exponent
+  const uint32_t remainder = mantissa & 0x1fffU;
+  if (remainder > 0x1000U || (remainder == 0x1000U && (half & 1U)))
+    ++half;
+  if ((half & 0x7c00U) == 0x7c00U)
+    return sign | max_normal;
+  return half;
+}
+
+uint32_t energy_lookup_table::tabulated_pixel_count() const
+{
+  return used_slot_count_;
+}
@@ -10,6 +10,10 @@ mm_hit::mm_hit(short x, short y, double toa, double e)
 
 mm_hit::mm_hit() {}
 
+mm_hit::time_type mm_hit::from_ns(double ns) { return ns; }
+
+double mm_hit::to_ns(time_type time) { return time; }
+
 const coord &mm_hit::coordinates() const { return coord_; }
 
 short mm_hit::x() const { return coord_.x_; }
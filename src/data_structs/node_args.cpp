@@ -38,7 +38,33 @@ node_args::operator[](const std::string &node_name)
 node_args::node_args()
 {
   args_data_ = {
-      {"reader", node_args_type({{"sleep_duration_full_memory", "100"}})},
-      {"clusterer", node_args_type({{"tile_size", "1"}, {"max_dt", "200"}})},
+      {"reader", node_args_type({{"sleep_duration_full_memory", "100"},
+                                 {"parse_thread_count", "0"}})},
+      {"raw_reader", node_args_type({{"prefetch_block_size", "4194304"},
+                                     {"prefetch_depth", "4"},
+                                     {"follow", "false"},
+                                     {"follow_timeout", "10000"},
+                                     {"follow_poll_interval", "100"},
+                                     {"window_start", "0"},
+                                     {"window_end", "-1"}})},
+      {"burda_to_mm_adapter",
+       node_args_type({{"energy_lut", "none"},
+                       {"energy_lut_memory_budget", "67108864"}})},
+      {"clusterer", node_args_type({{"tile_size", "1"},
+                                    {"max_dt", "200"},
+                                    {"morton_layout", "false"}})},
+      {"pooled_clusterer", node_args_type({{"tile_size", "1"},
+                                           {"max_dt", "200"},
+                                           {"pool_size", "65536"}})},
+      {"matrix_clusterer",
+       node_args_type({{"tile_size", "1"}, {"max_dt", "200"}})},
+      {"hit_sorter", node_args_type({{"dequeue_time", "500000"},
+                                     {"adaptive_dequeue", "false"},
+                                     {"min_dequeue_time", "5000"},
+                                     {"dequeue_time_margin", "2"}})},
+      {"time_wheel_sorter", node_args_type({{"dequeue_time", "500000"}})},
+      {"batch_sorter", node_args_type({{"dequeue_time", "500000"}})},
+      {"external_sorter", node_args_type({{"memory_budget", "268435456"}})},
+      {"dataflow_controller", node_args_type({{"sort_raw_hits", "false"}})},
   };
 }
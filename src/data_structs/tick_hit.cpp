@@ -0,0 +1,41 @@
+#include "data_structs/tick_hit.h"
+#include <cmath>
+
+// the same hit as mm_hit, but its time is an integer number of ticks
+// of the fast clock, so the time comparisons in the pipeline are exact
+// and the time is converted to nanoseconds only at the output
+
+tick_hit::tick_hit(short x, short y, int64_t toa, double e)
+  : coord_(x, y), toa_(toa), e_(e)
+{
+}
+
+tick_hit::tick_hit() {}
+
+tick_hit::time_type tick_hit::from_ns(double ns)
+{
+  return std::llround(ns / tick_ns);
+}
+
+double tick_hit::to_ns(time_type time) { return time * tick_ns; }
+
+const coord &tick_hit::coordinates() const { return coord_; }
+
+short tick_hit::x() const { return coord_.x_; }
+
+short tick_hit::y() const { return coord_.y_; }
+
+int64_t tick_hit::time() const { return toa(); }
+
+int64_t tick_hit::toa() const { return toa_; }
+
+double tick_hit::toa_ns() const { return to_ns(toa_); }
+
+double tick_hit::e() const { return e_; }
+
+bool tick_hit::approx_equals(const tick_hit &other)
+{
+  const double epsilon = 0.01;
+  return (x() == other.x() && y() == other.y() && toa() == other.toa() &&
+          std::abs(e() - other.e()) < epsilon);
+}
@@ -42,6 +42,9 @@ bool try_buffer_clustering()
   //3. use correct dataflow template arguments:
   // - raw_char_buffer - as we are processing data from char buffer
   // - raw_data_reader - the object capable of reading from this buffer
+  // - optionally the hit type (mm_hit, tick_hit or compact_hit) and the sorter
+  //   (hit_sorter, or time_wheel_sorter or batch_sorter which are faster at
+  //   high hit rates)
 
   std::vector<cluster<mm_hit>> clusters;
   dataflow_controller<raw_data_reader, raw_char_buffer> controller(
@@ -54,6 +57,15 @@ bool try_buffer_clustering()
           clusters.push_back(*it);
       });
 
+  // the hits which came too late for the window of the sorter are reported
+  // during the run, late_hit_count() can be polled from another thread too
+  controller.set_late_hit_callback(
+      [](uint64_t late_hit_count, double max_late_delay)
+      {
+        std::cout << "Late hits " << late_hit_count << ", max delay "
+                  << max_late_delay << " ns" << std::endl;
+      });
+
   // Note: all .run_pixel_list_clustering() calls have analogical
   // .run_temporal_split_clustering() variant which uses different clustering
   // algorithm - it will be optimized very soon*/
@@ -64,13 +76,14 @@ int main(int argc, char **argv)
 {
   if (try_buffer_clustering())
     return 0;
-  const uint16_t expected_arg_count = 3;
+  // the program name is passed as the first argument
+  const uint16_t expected_arg_count = 4;
   if (argc != expected_arg_count)
   {
 
     std::cout << "Error, passed " << argc - 1
-              << " arguments, but 2 arguments and 1 option is expected ([-t or "
-                 "-b] [data file] [calibration folder])"
+              << " arguments, but 2 arguments and 1 option is expected ([-t, -b, "
+                 "-bp, -bf, -bt or -bc] [data file] [calibration folder])"
               << std::endl;
     return 0;
   }
@@ -87,24 +100,78 @@ int main(int argc, char **argv)
   const std::string data_file = args[1];
   const std::string calib_folder = args[2];
 
-  if (args[0] == "-t")
+  if (prefetching_file_buffer::is_compressed(data_file) &&
+      (args[0] == "-t" || args[0] == "-b"))
+  {
+    // compressed file is decompressed ahead of processing by the I/O thread
+    if (args[0] == "-t")
+    {
+      dataflow_controller<data_reader, prefetching_file_buffer> controller(
+          calib_folder);
+      controller.run_pixel_list_clustering(data_file);
+    }
+    else
+    {
+      dataflow_controller<raw_data_reader, prefetching_file_buffer> controller(
+          calib_folder);
+      controller.run_pixel_list_clustering(data_file);
+      std::cout << controller.statistics() << std::endl;
+    }
+  }
+  else if (args[0] == "-t")
   {
     // choose approperiate dataflow_controller arguments
-    // reading from text stream
-    dataflow_controller<data_reader, std::ifstream> controller(calib_folder);
+    // parsing text file mapped to the memory
+    dataflow_controller<data_reader, mapped_char_buffer> controller(
+        calib_folder);
     controller.run_pixel_list_clustering(data_file);
   }
   else if (args[0] == "-b")
   {
-    // reading from binary stream
-    dataflow_controller<raw_data_reader, std::ifstream> controller(
+    // reading from binary file mapped to the memory
+    dataflow_controller<raw_data_reader, mapped_char_buffer> controller(
+        calib_folder);
+    controller.run_pixel_list_clustering(data_file);
+    std::cout << controller.statistics() << std::endl;
+  }
+  else if (args[0] == "-bp")
+  {
+    // reading from binary file ahead of processing by a separate I/O thread
+    dataflow_controller<raw_data_reader, prefetching_file_buffer> controller(
         calib_folder);
     controller.run_pixel_list_clustering(data_file);
+    std::cout << controller.statistics() << std::endl;
+  }
+  else if (args[0] == "-bf")
+  {
+    // reading from binary file which is still being written
+    node_args reader_args;
+    reader_args["raw_reader"]["follow"] = "true";
+    dataflow_controller<raw_data_reader, prefetching_file_buffer> controller(
+        calib_folder, reader_args);
+    controller.run_pixel_list_clustering(data_file);
+    std::cout << controller.statistics() << std::endl;
+  }
+  else if (args[0] == "-bt")
+  {
+    // the times are kept in integer ticks of the fast clock until the output
+    dataflow_controller<raw_data_reader, mapped_char_buffer, tick_hit>
+        controller(calib_folder);
+    controller.run_pixel_list_clustering(data_file);
+    std::cout << controller.statistics() << std::endl;
+  }
+  else if (args[0] == "-bc")
+  {
+    // the hits are stored in 16 bytes, the energy in single precision
+    dataflow_controller<raw_data_reader, mapped_char_buffer, compact_hit>
+        controller(calib_folder);
+    controller.run_pixel_list_clustering(data_file);
+    std::cout << controller.statistics() << std::endl;
   }
   else
   {
     std::cout << "Invalid file option passed '" << args[0]
-              << "', expected -t or -b" << std::endl;
+              << "', expected -t, -b, -bp, -bf, -bt or -bc" << std::endl;
   }
 
   std::cout << "Finished processing" << std::endl;
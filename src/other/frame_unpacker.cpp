@@ -0,0 +1,382 @@
+#include "other/frame_unpacker.h"
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRAME_UNPACKER_X86
+#endif
+
+// splits the raw Katherine frames to the hit fields, the fastest kernel
+// supported by the CPU is selected at runtime
+
+namespace
+{
+constexpr uint64_t TOA_OFFSET_MULTIPLIER =
+    frame_unpacker::TOA_OFFSET_MULTIPLIER;
+
+// handles a single frame, returns false once the measurement ended
+inline bool unpack_frame(uint64_t data_frame, frame_unpacker::state &state,
+                         unpacked_hits &hits)
+{
+  state.statistics.count(data_frame >> 44);
+  switch (static_cast<measurement_data_type>(data_frame >> 44))
+  {
+  case measurement_data_type::PIXEL_MEASUREMENT_DATA:
+  case measurement_data_type::KATHERINE_1_ID:
+  case measurement_data_type::KATHERINE_2_ID:
+    hits.linear_coord[hits.size] = (data_frame >> 28) & 0xffffULL;
+    hits.toa[hits.size] = ((data_frame >> 14) & 0x3fffULL) +
+                          TOA_OFFSET_MULTIPLIER * state.time_offset;
+    hits.tot[hits.size] = (data_frame >> 4) & 0x3ffULL;
+    hits.fast_toa[hits.size] = data_frame & 0xfULL;
+    ++hits.size;
+    return true;
+  case measurement_data_type::PIXEL_TIMESTAMP_OFFSET:
+    state.time_offset = data_frame & 0xffffffffULL;
+    return true;
+  case measurement_data_type::CURRENT_FRAME_FINISHED:
+    state.frame_finished = true;
+    return true;
+  case measurement_data_type::LOST_PIXEL_COUNT:
+    state.finished = true;
+    state.statistics.count_lost_pixels(data_frame & 0x0fffffffffULL);
+    return false;
+  default:
+    return true;
+  }
+}
+
+// scalar decoding of the frames starting at the given offset
+uint64_t unpack_remaining(const char *block, uint64_t byte_count,
+                          uint64_t offset, frame_unpacker::state &state,
+                          unpacked_hits &hits)
+{
+  const uint32_t frame_size = frame_unpacker::FRAME_BYTE_SIZE;
+  for (; offset + frame_size <= byte_count; offset += frame_size)
+  {
+    uint64_t data_frame = 0;
+    std::memcpy(&data_frame, block + offset, frame_size);
+    if (!unpack_frame(data_frame, state, hits))
+      return offset + frame_size;
+  }
+  return offset;
+}
+
+// counts the types of the pixel frames which were not all measurement data
+inline void count_pixel_frames(const char *block, uint64_t begin, uint64_t end,
+                               frame_statistics &statistics)
+{
+  const uint32_t frame_size = frame_unpacker::FRAME_BYTE_SIZE;
+  for (uint64_t offset = begin; offset < end; offset += frame_size)
+  {
+    uint64_t data_frame = 0;
+    std::memcpy(&data_frame, block + offset, frame_size);
+    statistics.count(data_frame >> 44);
+  }
+}
+
+// makes sure there is a space for all frames of the block
+inline void prepare_output(uint64_t byte_count, unpacked_hits &hits)
+{
+  hits.reserve(hits.size + byte_count / frame_unpacker::FRAME_BYTE_SIZE);
+}
+} // namespace
+
+uint64_t frame_unpacker::unpack_scalar(const char *block, uint64_t byte_count,
+                                       state &unpack_state,
+                                       unpacked_hits &hits)
+{
+  if (unpack_state.finished)
+    return 0;
+  prepare_output(byte_count, hits);
+  return unpack_remaining(block, byte_count, 0, unpack_state, hits);
+}
+
+#ifdef FRAME_UNPACKER_X86
+
+// two frames per iteration, the frames with any other type than pixel
+// data fall back to the scalar path
+__attribute__((target("sse4.1"))) uint64_t
+frame_unpacker::unpack_sse4(const char *block, uint64_t byte_count,
+                            state &unpack_state, unpacked_hits &hits)
+{
+  if (unpack_state.finished)
+    return 0;
+  prepare_output(byte_count, hits);
+  const uint32_t frames_per_step = 2;
+  const uint32_t step_size = frames_per_step * FRAME_BYTE_SIZE;
+  // each 6 byte frame is zero extended to its own 64 bit lane
+  const __m128i spread_frames =
+      _mm_setr_epi8(0, 1, 2, 3, 4, 5, -1, -1, 6, 7, 8, 9, 10, 11, -1, -1);
+  // gathers coords to dword 0, tots to dword 1 and fast toas to word 4
+  const __m128i gather_fields =
+      _mm_setr_epi8(0, 1, 8, 9, 2, 3, 10, 11, 4, 12, -1, -1, -1, -1, -1, -1);
+  const __m128i toa_mask = _mm_set1_epi64x(0x3fff);
+  const __m128i coord_mask = _mm_set1_epi64x(0xffff);
+  const __m128i tot_mask = _mm_set1_epi64x(0x3ffULL << 16);
+  const __m128i fast_toa_mask = _mm_set1_epi64x(0xfULL << 32);
+  const __m128i pixel_type = _mm_set1_epi64x(
+      static_cast<int64_t>(measurement_data_type::PIXEL_MEASUREMENT_DATA));
+  const __m128i katherine_1_type = _mm_set1_epi64x(
+      static_cast<int64_t>(measurement_data_type::KATHERINE_1_ID));
+  const __m128i katherine_2_type = _mm_set1_epi64x(
+      static_cast<int64_t>(measurement_data_type::KATHERINE_2_ID));
+
+  const uint32_t measurement_type =
+      static_cast<uint32_t>(measurement_data_type::PIXEL_MEASUREMENT_DATA);
+  // the measurement frames of the vector path are counted at once
+  uint64_t measurement_count = 0;
+  uint64_t offset = 0;
+  // the load reads 16 bytes, of which 12 are used
+  while (offset + sizeof(__m128i) <= byte_count)
+  {
+    const __m128i frames = _mm_shuffle_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + offset)),
+        spread_frames);
+    const __m128i types = _mm_srli_epi64(frames, 44);
+    const __m128i is_measurement = _mm_cmpeq_epi64(types, pixel_type);
+    const __m128i is_pixel =
+        _mm_or_si128(is_measurement,
+                     _mm_or_si128(_mm_cmpeq_epi64(types, katherine_1_type),
+                                  _mm_cmpeq_epi64(types, katherine_2_type)));
+    if (_mm_movemask_epi8(is_pixel) != 0xffff)
+    {
+      // offset update or control frame, decode both frames one by one
+      const uint64_t used = unpack_remaining(block, offset + step_size, offset,
+                                             unpack_state, hits);
+      if (unpack_state.finished)
+      {
+        unpack_state.statistics.count(measurement_type, measurement_count);
+        return used;
+      }
+      offset += step_size;
+      continue;
+    }
+    if (_mm_movemask_epi8(is_measurement) == 0xffff)
+      measurement_count += frames_per_step;
+    else
+      count_pixel_frames(block, offset, offset + step_size,
+                         unpack_state.statistics);
+    const __m128i toa = _mm_add_epi64(
+        _mm_and_si128(_mm_srli_epi64(frames, 14), toa_mask),
+        _mm_set1_epi64x(TOA_OFFSET_MULTIPLIER * unpack_state.time_offset));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(hits.toa.data() + hits.size),
+                     toa);
+    // pack coord, tot and fast toa to a single lane and then narrow them
+    const __m128i fields = _mm_or_si128(
+        _mm_and_si128(_mm_srli_epi64(frames, 28), coord_mask),
+        _mm_or_si128(_mm_and_si128(_mm_slli_epi64(frames, 12), tot_mask),
+                     _mm_and_si128(_mm_slli_epi64(frames, 32), fast_toa_mask)));
+    const __m128i narrowed = _mm_shuffle_epi8(fields, gather_fields);
+    const uint32_t coords = _mm_cvtsi128_si32(narrowed);
+    const uint32_t tots = _mm_extract_epi32(narrowed, 1);
+    const uint16_t fast_toas = _mm_extract_epi16(narrowed, 4);
+    std::memcpy(hits.linear_coord.data() + hits.size, &coords, sizeof(coords));
+    std::memcpy(hits.tot.data() + hits.size, &tots, sizeof(tots));
+    std::memcpy(hits.fast_toa.data() + hits.size, &fast_toas,
+                sizeof(fast_toas));
+    hits.size += frames_per_step;
+    offset += step_size;
+  }
+  unpack_state.statistics.count(measurement_type, measurement_count);
+  return unpack_remaining(block, byte_count, offset, unpack_state, hits);
+}
+
+// four frames per iteration, the frames with any other type than pixel
+// data fall back to the scalar path
+__attribute__((target("avx2"))) uint64_t
+frame_unpacker::unpack_avx2(const char *block, uint64_t byte_count,
+                            state &unpack_state, unpacked_hits &hits)
+{
+  if (unpack_state.finished)
+    return 0;
+  prepare_output(byte_count, hits);
+  const uint32_t frames_per_step = 4;
+  const uint32_t step_size = frames_per_step * FRAME_BYTE_SIZE;
+  // the upper half is loaded from the 12th byte, each 6 byte frame is then
+  // zero extended to its own 64 bit lane
+  const __m256i spread_frames = _mm256_setr_epi8(
+      0, 1, 2, 3, 4, 5, -1, -1, 6, 7, 8, 9, 10, 11, -1, -1, 0, 1, 2, 3, 4, 5,
+      -1, -1, 6, 7, 8, 9, 10, 11, -1, -1);
+  // the lower half gathers the fields of frames 0 and 1, the upper half of
+  // frames 2 and 3, OR-ing the halves gives 4 coords followed by 4 tots
+  const __m256i gather_coord_tot = _mm256_setr_epi8(
+      0, 1, 8, 9, -1, -1, -1, -1, 2, 3, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1,
+      0, 1, 8, 9, -1, -1, -1, -1, 2, 3, 10, 11);
+  const __m256i gather_fast_toa = _mm256_setr_epi8(
+      4, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 4,
+      12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m256i toa_mask = _mm256_set1_epi64x(0x3fff);
+  const __m256i coord_mask = _mm256_set1_epi64x(0xffff);
+  const __m256i tot_mask = _mm256_set1_epi64x(0x3ffULL << 16);
+  const __m256i fast_toa_mask = _mm256_set1_epi64x(0xfULL << 32);
+  const __m256i pixel_type = _mm256_set1_epi64x(
+      static_cast<int64_t>(measurement_data_type::PIXEL_MEASUREMENT_DATA));
+  const __m256i katherine_1_type = _mm256_set1_epi64x(
+      static_cast<int64_t>(measurement_data_type::KATHERINE_1_ID));
+  const __m256i katherine_2_type = _mm256_set1_epi64x(
+      static_cast<int64_t>(measurement_data_type::KATHERINE_2_ID));
+
+  const uint32_t measurement_type =
+      static_cast<uint32_t>(measurement_data_type::PIXEL_MEASUREMENT_DATA);
+  // the measurement frames of the vector path are counted at once
+  uint64_t measurement_count = 0;
+  uint64_t offset = 0;
+  // the loads read 12 + 16 bytes, of which 24 are used
+  while (offset + step_size / 2 + sizeof(__m128i) <= byte_count)
+  {
+    const char *frame_ptr = block + offset;
+    const __m256i loaded = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(frame_ptr))),
+        _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(frame_ptr + step_size / 2)),
+        1);
+    const __m256i frames = _mm256_shuffle_epi8(loaded, spread_frames);
+    const __m256i types = _mm256_srli_epi64(frames, 44);
+    const __m256i is_measurement = _mm256_cmpeq_epi64(types, pixel_type);
+    const __m256i is_pixel = _mm256_or_si256(
+        is_measurement,
+        _mm256_or_si256(_mm256_cmpeq_epi64(types, katherine_1_type),
+                        _mm256_cmpeq_epi64(types, katherine_2_type)));
+    if (_mm256_movemask_epi8(is_pixel) != -1)
+    {
+      // offset update or control frame, decode the frames one by one
+      const uint64_t used = unpack_remaining(block, offset + step_size, offset,
+                                             unpack_state, hits);
+      if (unpack_state.finished)
+      {
+        unpack_state.statistics.count(measurement_type, measurement_count);
+        return used;
+      }
+      offset += step_size;
+      continue;
+    }
+    if (_mm256_movemask_epi8(is_measurement) == -1)
+      measurement_count += frames_per_step;
+    else
+      count_pixel_frames(block, offset, offset + step_size,
+                         unpack_state.statistics);
+    const __m256i toa = _mm256_add_epi64(
+        _mm256_and_si256(_mm256_srli_epi64(frames, 14), toa_mask),
+        _mm256_set1_epi64x(TOA_OFFSET_MULTIPLIER * unpack_state.time_offset));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i *>(hits.toa.data() + hits.size), toa);
+    // pack coord, tot and fast toa to a single lane and then narrow them
+    const __m256i fields = _mm256_or_si256(
+        _mm256_and_si256(_mm256_srli_epi64(frames, 28), coord_mask),
+        _mm256_or_si256(
+            _mm256_and_si256(_mm256_slli_epi64(frames, 12), tot_mask),
+            _mm256_and_si256(_mm256_slli_epi64(frames, 32), fast_toa_mask)));
+    const __m256i coord_tot = _mm256_shuffle_epi8(fields, gather_coord_tot);
+    const __m128i coords_tots =
+        _mm_or_si128(_mm256_castsi256_si128(coord_tot),
+                     _mm256_extracti128_si256(coord_tot, 1));
+    const __m256i fast_toa = _mm256_shuffle_epi8(fields, gather_fast_toa);
+    const uint32_t fast_toas =
+        _mm_cvtsi128_si32(_mm_or_si128(_mm256_castsi256_si128(fast_toa),
+                                       _mm256_extracti128_si256(fast_toa, 1)));
+    _mm_storel_epi64(
+        reinterpret_cast<__m128i *>(hits.linear_coord.data() + hits.size),
+        coords_tots);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(hits.tot.data() + hits.size),
+                     _mm_unpackhi_epi64(coords_tots, coords_tots));
+    std::memcpy(hits.fast_toa.data() + hits.size, &fast_toas,
+                sizeof(fast_toas));
+    hits.size += frames_per_step;
+    offset += step_size;
+  }
+  unpack_state.statistics.count(measurement_type, measurement_count);
+  return unpack_remaining(block, byte_count, offset, unpack_state, hits);
+}
+
+#else
+
+uint64_t frame_unpacker::unpack_sse4(const char *block, uint64_t byte_count,
+                                     state &unpack_state, unpacked_hits &hits)
+{
+  return unpack_scalar(block, byte_count, unpack_state, hits);
+}
+
+uint64_t frame_unpacker::unpack_avx2(const char *block, uint64_t byte_count,
+                                     state &unpack_state, unpacked_hits &hits)
+{
+  return unpack_scalar(block, byte_count, unpack_state, hits);
+}
+
+#endif
+
+frame_unpacker::frame_unpacker()
+  : kernel_(unpack_scalar), kernel_name_("scalar")
+{
+#ifdef FRAME_UNPACKER_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+  {
+    kernel_ = unpack_avx2;
+    kernel_name_ = "avx2";
+  }
+  else if (__builtin_cpu_supports("sse4.1"))
+  {
+    kernel_ = unpack_sse4;
+    kernel_name_ = "sse4";
+  }
+#endif
+}
+
+uint64_t frame_unpacker::unpack(const char *block, uint64_t byte_count,
+                                state &unpack_state, unpacked_hits &hits) const
+{
+  return kernel_(block, byte_count, unpack_state, hits);
+}
+
+std::string frame_unpacker::kernel_name() const { return kernel_name_; }
+
+frame_statistics &frame_statistics::operator=(const frame_statistics &other)
+{
+  for (uint32_t i = 0; i < FRAME_TYPE_COUNT; ++i)
+    frame_counts[i].store(other.frame_counts[i].load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+  lost_pixel_count.store(other.lost_pixel_count.load(std::memory_order_relaxed),
+                         std::memory_order_relaxed);
+  return *this;
+}
+
+uint64_t frame_statistics::total_frame_count() const
+{
+  uint64_t total = 0;
+  for (const auto &type_count : frame_counts)
+    total += type_count.load(std::memory_order_relaxed);
+  return total;
+}
+
+uint64_t frame_statistics::pixel_frame_count() const
+{
+  return frame_count(measurement_data_type::PIXEL_MEASUREMENT_DATA) +
+         frame_count(measurement_data_type::KATHERINE_1_ID) +
+         frame_count(measurement_data_type::KATHERINE_2_ID);
+}
+
+uint64_t frame_statistics::offset_update_count() const
+{
+  return frame_count(measurement_data_type::PIXEL_TIMESTAMP_OFFSET);
+}
+
+uint64_t frame_statistics::unknown_frame_count() const
+{
+  return total_frame_count() - pixel_frame_count() - offset_update_count() -
+         frame_count(measurement_data_type::CURRENT_FRAME_FINISHED) -
+         frame_count(measurement_data_type::LOST_PIXEL_COUNT);
+}
+
+std::ostream &operator<<(std::ostream &os, const frame_statistics &statistics)
+{
+  os << "Frames: " << statistics.total_frame_count()
+     << ", pixel hits: " << statistics.pixel_frame_count()
+     << ", offset updates: " << statistics.offset_update_count()
+     << ", finished frames: "
+     << statistics.frame_count(measurement_data_type::CURRENT_FRAME_FINISHED)
+     << ", unknown frames: " << statistics.unknown_frame_count()
+     << ", lost pixels in Katherine: "
+     << statistics.lost_pixel_count.load(std::memory_order_relaxed);
+  return os;
+}
@@ -0,0 +1,91 @@
+#include "other/mapped_file.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+// read-only memory mapping of a whole file, the pages are read directly
+// from the page cache, without any copy to the user space
+
+mapped_file::mapped_file(const std::string &file_name, access_pattern pattern)
+{
+  int fd = ::open(file_name.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat file_stat;
+  if (::fstat(fd, &file_stat) != 0)
+  {
+    ::close(fd);
+    return;
+  }
+  size_ = file_stat.st_size;
+  is_open_ = true;
+  if (size_ > 0)
+  {
+    void *mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+      size_ = 0;
+      is_open_ = false;
+    }
+    else
+    {
+      data_ = static_cast<char *>(mapping);
+      ::madvise(mapping, size_,
+                pattern == access_pattern::SEQUENTIAL ? MADV_SEQUENTIAL
+                                                      : MADV_RANDOM);
+    }
+  }
+  // the mapping stays valid after the descriptor is closed
+  ::close(fd);
+}
+
+mapped_file::mapped_file(mapped_file &&other)
+  : data_(std::exchange(other.data_, nullptr)),
+    size_(std::exchange(other.size_, 0)),
+    is_open_(std::exchange(other.is_open_, false))
+{
+}
+
+mapped_file &mapped_file::operator=(mapped_file &&other)
+{
+  if (this != &other)
+  {
+    unmap();
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+    is_open_ = std::exchange(other.is_open_, false);
+  }
+  return *this;
+}
+
+mapped_file::~mapped_file() { unmap(); }
+
+void mapped_file::unmap()
+{
+  if (data_ != nullptr)
+    ::munmap(data_, size_);
+  data_ = nullptr;
+  size_ = 0;
+  is_open_ = false;
+}
+
+void mapped_file::prefetch(uint64_t offset, uint64_t byte_count) const
+{
+  if (offset >= size_)
+    return;
+  // madvise requires a page aligned address
+  const uint64_t page_size = ::sysconf(_SC_PAGESIZE);
+  const uint64_t aligned_offset = offset - offset % page_size;
+  byte_count = std::min(byte_count + offset - aligned_offset,
+                        size_ - aligned_offset);
+  ::madvise(data_ + aligned_offset, byte_count, MADV_WILLNEED);
+}
+
+char *mapped_file::data() const { return data_; }
+
+uint64_t mapped_file::size() const { return size_; }
+
+bool mapped_file::is_open() const { return is_open_; }
@@ -0,0 +1,266 @@
+#include "other/prefetching_file_buffer.h"
+#include "other/utils.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <unistd.h>
+#ifdef CLUSTERER_USE_BOOST_IOSTREAMS
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/zstd.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#endif
+
+// binary file read ahead by a dedicated I/O thread into a ring of blocks,
+// the consumer accesses the blocks directly without copying them,
+// gzip (.gz) and zstd (.zst) files are decompressed by the I/O thread
+
+// the open mode is accepted as by std::ifstream, the file is always binary
+prefetching_file_buffer::prefetching_file_buffer(const std::string &file_name,
+                                                 std::ios::openmode,
+                                                 uint64_t block_size,
+                                                 uint32_t depth)
+  : ring_(std::max(depth, 2U)),
+    block_size_(std::max<uint64_t>(block_size / FRAME_BYTE_SIZE, 1) *
+                FRAME_BYTE_SIZE)
+{
+  if (is_compressed(file_name))
+    open_compressed(file_name);
+  else
+    open_file(file_name);
+  if (!is_open())
+    return;
+  for (auto &ring_block : ring_)
+    ring_block.data.resize(block_size_);
+}
+
+bool prefetching_file_buffer::is_compressed(const std::string &file_name)
+{
+  return ends_with(file_name, ".gz") || ends_with(file_name, ".zst") ||
+         ends_with(file_name, ".zstd");
+}
+
+void prefetching_file_buffer::open_file(const std::string &file_name)
+{
+  file_descriptor_ = ::open(file_name.c_str(), O_RDONLY);
+  if (file_descriptor_ < 0)
+    return;
+#ifdef POSIX_FADV_SEQUENTIAL
+  ::posix_fadvise(file_descriptor_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  const int file_descriptor = file_descriptor_;
+  read_function_ = [file_descriptor](char *buffer, uint64_t byte_count,
+                                     uint64_t offset) -> int64_t
+  { return ::pread(file_descriptor, buffer, byte_count, offset); };
+}
+
+void prefetching_file_buffer::open_compressed(const std::string &file_name)
+{
+#ifdef CLUSTERER_USE_BOOST_IOSTREAMS
+  auto file = std::make_shared<std::ifstream>(file_name, std::ios::binary);
+  if (!file->is_open())
+    return;
+  auto stream = std::make_shared<boost::iostreams::filtering_istream>();
+  if (ends_with(file_name, ".gz"))
+    stream->push(boost::iostreams::gzip_decompressor());
+  else
+    stream->push(boost::iostreams::zstd_decompressor());
+  stream->push(*file);
+  seekable_ = false;
+  // the stream is only read sequentially, the offset is not needed
+  read_function_ = [file, stream](char *buffer, uint64_t byte_count,
+                                  uint64_t) -> int64_t
+  {
+    try
+    {
+      stream->read(buffer, byte_count);
+    }
+    catch (const std::ios_base::failure &)
+    {
+      return -1;
+    }
+    if (stream->bad())
+      return -1;
+    return stream->gcount();
+  };
+#else
+  throw std::invalid_argument("Compressed input file '" + file_name +
+                              "' requires a build with Boost.Iostreams");
+#endif
+}
+
+bool prefetching_file_buffer::is_following()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return following_;
+}
+
+prefetching_file_buffer::~prefetching_file_buffer()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  block_released_.notify_all();
+  if (io_thread_.joinable())
+    io_thread_.join();
+  if (file_descriptor_ >= 0)
+    ::close(file_descriptor_);
+}
+
+bool prefetching_file_buffer::wait_for_data(
+    std::chrono::steady_clock::time_point last_data_time)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!following_ || stop_ ||
+      std::chrono::steady_clock::now() - last_data_time > follow_timeout_)
+    return false;
+  block_released_.wait_for(lock, poll_interval_,
+                           [this]() { return stop_ || !following_; });
+  return !stop_;
+}
+
+void prefetching_file_buffer::read_ahead()
+{
+  uint64_t file_offset = 0;
+  bool end_of_file = false;
+  auto last_data_time = std::chrono::steady_clock::now();
+  while (!end_of_file)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      block_released_.wait(
+          lock, [this]() { return stop_ || filled_count_ < ring_.size(); });
+      if (stop_)
+        return;
+    }
+    // the block is not visible to the consumer until it is filled
+    block &current = ring_[fill_index_];
+    current.size = 0;
+    bool failed = false;
+    while (current.size < block_size_)
+    {
+      int64_t read_count =
+          read_function_(current.data.data() + current.size,
+                         block_size_ - current.size, file_offset);
+      if (read_count < 0)
+      {
+        failed = true;
+        break;
+      }
+      if (read_count > 0)
+      {
+        current.size += read_count;
+        file_offset += read_count;
+        last_data_time = std::chrono::steady_clock::now();
+        continue;
+      }
+      if (!is_following())
+        break;
+      // at the end of the followed file the whole frames read so far are
+      // passed on, a frame being written is read again with the next block
+      const uint64_t whole_size =
+          current.size - current.size % FRAME_BYTE_SIZE;
+      if (whole_size > 0)
+      {
+        file_offset -= current.size - whole_size;
+        current.size = whole_size;
+        break;
+      }
+      if (!wait_for_data(last_data_time))
+        break;
+    }
+    // an empty block marks the end of the file or a failed read
+    if (failed)
+      current.size = 0;
+    end_of_file = current.size == 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (failed)
+        read_failed_ = true;
+      fill_index_ = (fill_index_ + 1) % ring_.size();
+      ++filled_count_;
+    }
+    block_filled_.notify_one();
+  }
+}
+
+void prefetching_file_buffer::release_block()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --filled_count_;
+    consume_index_ = (consume_index_ + 1) % ring_.size();
+  }
+  consume_offset_ = 0;
+  holding_block_ = false;
+  block_released_.notify_one();
+}
+
+uint64_t prefetching_file_buffer::read_block(const char *&block,
+                                             uint64_t byte_count)
+{
+  if (holding_block_ && consume_offset_ == ring_[consume_index_].size &&
+      ring_[consume_index_].size > 0)
+    release_block();
+  // the I/O thread is started by the first read, so it never reaches the end
+  // of the file before the buffer is configured to follow it
+  if (!io_thread_.joinable() && is_open())
+    io_thread_ = std::thread(&prefetching_file_buffer::read_ahead, this);
+  if (!holding_block_)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    block_filled_.wait(lock, [this]() { return filled_count_ > 0; });
+    holding_block_ = true;
+  }
+  const auto &current = ring_[consume_index_];
+  if (current.size == 0 && read_failed_)
+    throw std::runtime_error("Reading of the input file failed");
+  byte_count = std::min(byte_count, current.size - consume_offset_);
+  block = current.data.data() + consume_offset_;
+  consume_offset_ += byte_count;
+  return byte_count;
+}
+
+bool prefetching_file_buffer::read(char *read_bytes, uint32_t byte_count)
+{
+  uint32_t copied = 0;
+  while (copied < byte_count)
+  {
+    const char *block = nullptr;
+    uint64_t available = read_block(block, byte_count - copied);
+    if (available == 0)
+      break;
+    std::memcpy(read_bytes + copied, block, available);
+    copied += available;
+  }
+  return copied > 0;
+}
+
+void prefetching_file_buffer::follow(std::chrono::milliseconds timeout,
+                                     std::chrono::milliseconds poll_interval)
+{
+  if (!seekable_)
+    throw std::invalid_argument(
+        "The compressed input can not be followed while it is written");
+  if (io_thread_.joinable())
+    throw std::invalid_argument(
+        "The input can be followed only before it is read");
+  std::lock_guard<std::mutex> lock(mutex_);
+  following_ = true;
+  follow_timeout_ = timeout;
+  poll_interval_ = poll_interval;
+}
+
+void prefetching_file_buffer::stop_following()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    following_ = false;
+  }
+  block_released_.notify_all();
+}
+
+bool prefetching_file_buffer::is_open() { return read_function_ != nullptr; }
@@ -0,0 +1,164 @@
+#include "other/raw_file_index.h"
+#include "other/frame_unpacker.h"
+#include "other/mapped_file.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+// sparse index of the PIXEL_TIMESTAMP_OFFSET frames of a raw file,
+// the decoding can be started at any indexed frame with the correct state,
+// so the file can be processed from a chosen time or split to shards
+
+raw_file_index raw_file_index::build(const std::string &raw_file_name,
+                                     uint64_t stride)
+{
+  mapped_file raw_file(raw_file_name, mapped_file::access_pattern::SEQUENTIAL);
+  if (!raw_file.is_open())
+    throw std::invalid_argument("Could not open the raw file to be indexed: '" +
+                                raw_file_name + "'");
+  const uint32_t frame_size = frame_unpacker::FRAME_BYTE_SIZE;
+  stride = std::max<uint64_t>(stride, frame_size);
+  raw_file_index index;
+  index.source_ = read_source_state(raw_file.data(), raw_file.size());
+  // the next offset frame at or after this position is indexed
+  uint64_t next_indexed_position = 0;
+  for (uint64_t position = 0; position + frame_size <= raw_file.size();
+       position += frame_size)
+  {
+    uint64_t data_frame = 0;
+    std::memcpy(&data_frame, raw_file.data() + position, frame_size);
+    if (static_cast<measurement_data_type>(data_frame >> 44) !=
+            measurement_data_type::PIXEL_TIMESTAMP_OFFSET ||
+        position < next_indexed_position)
+      continue;
+    index.entries_.push_back(
+        entry{position, static_cast<int64_t>(data_frame & 0xffffffffULL)});
+    next_indexed_position = position + stride;
+  }
+  return index;
+}
+
+raw_file_index raw_file_index::load(const std::string &index_file_name)
+{
+  std::ifstream index_file(index_file_name);
+  if (!index_file.is_open())
+    throw std::invalid_argument("Could not open the index file: '" +
+                                index_file_name + "'");
+  raw_file_index index;
+  std::string line;
+  while (std::getline(index_file, line))
+  {
+    std::istringstream line_stream(line);
+    std::string key;
+    if (line.rfind("# raw_file_size", 0) == 0)
+    {
+      line_stream >> key >> key >> index.source_.size >> key >>
+          index.source_.checksum;
+      continue;
+    }
+    if (line.empty() || line[0] == '#')
+      continue;
+    entry indexed_frame;
+    if (!(line_stream >> indexed_frame.byte_position >>
+          indexed_frame.time_offset))
+      throw std::invalid_argument("Invalid line in the index file: '" +
+                                  index_file_name + "'");
+    index.entries_.push_back(indexed_frame);
+  }
+  return index;
+}
+
+raw_file_index raw_file_index::open(const std::string &raw_file_name)
+{
+  const std::string index_file_name = sidecar_name(raw_file_name);
+  // the index written before the last change of the raw file is rebuilt,
+  // the same as the invalid one
+  if (std::ifstream(index_file_name).is_open())
+  {
+    mapped_file raw_file(raw_file_name, mapped_file::access_pattern::RANDOM);
+    if (raw_file.is_open())
+    {
+      try
+      {
+        raw_file_index index = load(index_file_name);
+        const source_state source =
+            read_source_state(raw_file.data(), raw_file.size());
+        if (index.source_.size == source.size &&
+            index.source_.checksum == source.checksum)
+          return index;
+      }
+      catch (const std::invalid_argument &)
+      {
+      }
+    }
+  }
+  raw_file_index index = build(raw_file_name);
+  // the index is only a cache, the directory of the raw file can be read-only
+  try
+  {
+    index.save(index_file_name);
+  }
+  catch (const std::invalid_argument &)
+  {
+  }
+  return index;
+}
+
+std::string raw_file_index::sidecar_name(const std::string &raw_file_name)
+{
+  return raw_file_name + ".idx";
+}
+
+void raw_file_index::save(const std::string &index_file_name) const
+{
+  std::ofstream index_file(index_file_name);
+  if (!index_file.is_open())
+    throw std::invalid_argument("Could not create the index file: '" +
+                                index_file_name + "'");
+  index_file << "# raw_file_size " << source_.size << " raw_file_checksum "
+             << source_.checksum << "\n";
+  index_file << "# byte_position time_offset" << std::endl;
+  for (const auto &indexed_frame : entries_)
+    index_file << indexed_frame.byte_position << " "
+               << indexed_frame.time_offset << "\n";
+}
+
+const raw_file_index::entry *raw_file_index::find(int64_t toa) const
+{
+  // hits preceding an entry have the time offset of the entry at most,
+  // so their ToA is lower than the end of its frame ToA range
+  auto is_before = [](int64_t toa, const entry &indexed_frame)
+  {
+    return toa < frame_unpacker::TOA_OFFSET_MULTIPLIER *
+                         indexed_frame.time_offset +
+                     frame_unpacker::FRAME_TOA_RANGE;
+  };
+  auto first_after =
+      std::upper_bound(entries_.begin(), entries_.end(), toa, is_before);
+  if (first_after == entries_.begin())
+    return nullptr;
+  return &*std::prev(first_after);
+}
+
+const std::vector<raw_file_index::entry> &raw_file_index::entries() const
+{
+  return entries_;
+}
+
+raw_file_index::source_state
+raw_file_index::read_source_state(const char *data, uint64_t size)
+{
+  // FNV-1a over the first and the last bytes, they overlap in small files
+  source_state source;
+  source.size = size;
+  source.checksum = 0xcbf29ce484222325ULL;
+  const uint64_t hashed_size = std::min(size, CHECKSUM_BYTE_COUNT);
+  const uint64_t tail_begin = size - hashed_size;
+  for (uint64_t begin : {uint64_t(0), tail_begin})
+    for (uint64_t i = begin; i < begin + hashed_size; ++i)
+      source.checksum =
+          (source.checksum ^ uint8_t(data[i])) * 0x100000001b3ULL;
+  return source;
+}
@@ -114,6 +114,34 @@ int32_t coord::linearize_tiled(
   return (MAX_VALUE / tile_size) * x_ + y_;
 }
 
+// spreads the lower 16 bits to the even bits
+static uint32_t spread_bits(uint32_t value)
+{
+  value &= 0x0000ffff;
+  value = (value | (value << 8)) & 0x00ff00ff;
+  value = (value | (value << 4)) & 0x0f0f0f0f;
+  value = (value | (value << 2)) & 0x33333333;
+  value = (value | (value << 1)) & 0x55555555;
+  return value;
+}
+
+int32_t coord::linearize_morton(
+    uint32_t tile_size) const // use if untiled coord -> tiled Z-order
+{
+  // the bits of x and y are interleaved, so the neighboring pixels are close
+  // in both directions
+  return (spread_bits(x_ / tile_size) << 1) | spread_bits(y_ / tile_size);
+}
+
+uint32_t coord::morton_size(uint32_t tile_size)
+{
+  // the Z-order covers a square with the side being a power of two
+  uint32_t side = 1;
+  while (side < MAX_VALUE / tile_size)
+    side <<= 1;
+  return side * side;
+}
+
 bool coord::is_valid_neighbor(const coord &neighbor, int32_t tile_size) const
 {
   // Note expression obtained after multiplying the whole formula by tile_size